@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * This file is part of UGS (Universal Graphics Surface)
+ * Source code: https://github.com/wang-bin/ugs
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "ugs/FrameSource.h"
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+UGS_NS_BEGIN
+using namespace std;
+
+class FrameSource::Private
+{
+public:
+    mutex mtx;
+    function<void()> trigger = nullptr;
+};
+
+FrameSource::FrameSource()
+    : d(new Private())
+{
+}
+
+FrameSource::~FrameSource()
+{
+    delete d;
+}
+
+void FrameSource::requestFrame()
+{
+    function<void()> cb;
+    {
+        const lock_guard lock(d->mtx);
+        cb = d->trigger;
+    }
+    // trigger locks RenderLoop internals, do not hold mtx to avoid lock order inversion
+    if (cb)
+        cb();
+}
+
+void FrameSource::setTrigger(const function<void()>& cb)
+{
+    const lock_guard lock(d->mtx);
+    d->trigger = cb;
+}
+
+
+class VSyncFrameSource::Fallback
+{
+public:
+    ~Fallback() {
+        halt();
+    }
+
+    void launch(FrameSource* source) {
+        halt();
+        stop = false;
+        armed = false;
+        th = thread([this, source]{
+            unique_lock lock(mtx);
+            while (!stop) {
+                if (!armed) {
+                    cv.wait(lock, [this]{ return stop || armed;});
+                    continue;
+                }
+                if (cv.wait_until(lock, deadline, [this]{ return stop || !armed;})) // presented, or stopped
+                    continue;
+                armed = false;
+                lock.unlock();
+                source->requestFrame();
+                lock.lock();
+            }
+        });
+    }
+
+    void halt() {
+        {
+            const lock_guard lock(mtx);
+            stop = true;
+        }
+        cv.notify_all();
+        if (th.joinable())
+            th.join();
+    }
+
+    // request a frame after about 1 vblank at 60Hz unless disarmed
+    void arm() {
+        {
+            const lock_guard lock(mtx);
+            if (stop)
+                return;
+            armed = true;
+            deadline = chrono::steady_clock::now() + chrono::microseconds(16667);
+        }
+        cv.notify_one();
+    }
+
+    void disarm() {
+        if (!armed.load(memory_order_relaxed)) // no lock for every presented frame
+            return;
+        const lock_guard lock(mtx);
+        armed = false;
+    }
+
+    atomic<bool> armed = false;
+    bool stop = true;
+    chrono::steady_clock::time_point deadline;
+    mutex mtx;
+    condition_variable cv;
+    thread th;
+};
+
+VSyncFrameSource::VSyncFrameSource()
+    : fallback_(new Fallback())
+{
+}
+
+VSyncFrameSource::~VSyncFrameSource()
+{
+    delete fallback_;
+}
+
+void VSyncFrameSource::start()
+{
+    fallback_->launch(this);
+    requestFrame();
+}
+
+void VSyncFrameSource::stop()
+{
+    fallback_->halt();
+}
+
+void VSyncFrameSource::presented()
+{
+    fallback_->disarm();
+    requestFrame();
+}
+
+void VSyncFrameSource::idle()
+{
+    fallback_->arm();
+}
+
+
+class TimerFrameSource::Clock
+{
+public:
+    ~Clock() {
+        halt();
+    }
+
+    void launch(FrameSource* source) {
+        halt();
+        if (fps <= 0)
+            return;
+        stop = false;
+        th = thread([this, source]{
+            using namespace chrono;
+            const duration<double> period(1.0 / fps.load());
+            // absolute deadlines t0 + n*period, rounding errors do not accumulate as next += period does
+            const auto t0 = steady_clock::now();
+            int64_t n = 0;
+            unique_lock lock(mtx);
+            while (!stop) {
+                const auto deadline = t0 + duration_cast<steady_clock::duration>(period * ++n);
+                if (cv.wait_until(lock, deadline, [this]{ return stop;}))
+                    break;
+                source->requestFrame();
+                const auto late = steady_clock::now() - t0;
+                const auto due = int64_t(floor(duration_cast<duration<double>>(late) / period));
+                if (due > n) { // overrun, skip missed deadlines and continue from the next one
+                    dropped += due - n;
+                    n = due;
+                }
+            }
+        });
+    }
+
+    void halt() {
+        {
+            const lock_guard lock(mtx);
+            stop = true;
+        }
+        cv.notify_all();
+        if (th.joinable())
+            th.join();
+    }
+
+    atomic<bool> active = false;
+    atomic<float> fps = 0;
+    atomic<uint64_t> dropped = 0;
+    bool stop = true;
+    mutex mtx;
+    condition_variable cv;
+    thread th;
+};
+
+TimerFrameSource::TimerFrameSource(float fps)
+    : clock_(new Clock())
+{
+    clock_->fps = fps;
+}
+
+TimerFrameSource::~TimerFrameSource()
+{
+    delete clock_;
+}
+
+void TimerFrameSource::setFrameRate(float fps)
+{
+    if (clock_->fps == fps)
+        return;
+    clock_->fps = fps;
+    if (clock_->active)
+        clock_->launch(this);
+}
+
+float TimerFrameSource::frameRate() const
+{
+    return clock_->fps;
+}
+
+uint64_t TimerFrameSource::droppedTicks() const
+{
+    return clock_->dropped;
+}
+
+void TimerFrameSource::start()
+{
+    clock_->active = true;
+    clock_->launch(this);
+}
+
+void TimerFrameSource::stop()
+{
+    clock_->active = false;
+    clock_->halt();
+}
+
+
+ExternalClockFrameSource::ExternalClockFrameSource(float fps)
+    : fps_(fps)
+{
+}
+
+void ExternalClockFrameSource::setFrameRate(float fps)
+{
+    fps_ = fps;
+    next_ = 0;
+}
+
+void ExternalClockFrameSource::setClock(double value)
+{
+    const double fps = fps_;
+    if (fps <= 0) {
+        requestFrame();
+        return;
+    }
+    auto next = next_.load(memory_order_relaxed);
+    // seek backward, or next frame time is unknown
+    if (next <= 0 || value < next - 2.0 / fps)
+        next = value;
+    if (value < next) {
+        next_.store(next, memory_order_relaxed);
+        return;
+    }
+    requestFrame();
+    // the next frame boundary after value. missed frames are skipped
+    next_.store((floor(value * fps) + 1.0) / fps, memory_order_relaxed);
+}
+UGS_NS_END
@@ -12,6 +12,7 @@ extern "C" {
 #include <xf86drmMode.h>
 #include <gbm.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 }
 // symbols does not exist on raspian 7(libgbm 8.0.5-4+deb7u2+rpi)
@@ -37,6 +38,8 @@ public:
     ~GBMSurface() override;
     void* nativeResource() const override { return dev_;}
     void submit() override;
+    void processEvents() override;
+    int eventFd() const override { return connector_ ? drm_fd_ : -1;}
     bool size(int *w, int *h) const override {
         if (w)
             *w = mode_.hdisplay;
@@ -198,6 +201,19 @@ GBMSurface::~GBMSurface()
     ::close(drm_fd_);
 }
 
+void GBMSurface::processEvents()
+{
+    if (!connector_)
+        return;
+    // drain drm events(vblank, page flip), drmHandleEvent() blocks if nothing to read
+    pollfd pfd{drm_fd_, POLLIN, 0};
+    if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN))
+        return;
+    drmEventContext ctx{};
+    ctx.version = 2; // DRM_EVENT_CONTEXT_VERSION may be newer than runtime libdrm
+    drmHandleEvent(drm_fd_, &ctx);
+}
+
 void GBMSurface::submit()
 {
     struct gbm_bo *bo = gbm_surface_lock_front_buffer(surf_);
@@ -9,6 +9,8 @@
  */
 #include "ugs/PlatformSurface.h"
 #include "base/mpsc_fifo.h"
+#include "base/spsc_ring.h"
+#include <thread>
 #if (__APPLE__+0)
 # include <TargetConditionals.h> // TARGET_OS_IPHONE/OSX
 #endif
@@ -96,12 +98,46 @@ PlatformSurface* PlatformSurface::create(void* handle, Type type)
 class PlatformSurface::Private
 {
 public:
-    bool closed = false;
+    atomic<bool> closed = false; // Close event is pushed
     PlatformSurface::Type type = PlatformSurface::Type::Default;
-    void* native_handle = nullptr;
+    atomic<void*> native_handle = nullptr; // set in user thread, read in rendering threads
     std::function<void(void*)> handle_cb = nullptr;
     std::function<void()> cb = nullptr;
-    mpsc_fifo<PlatformSurface::Event> events;
+    struct Queued {
+        uint64_t seq = 0; // in events: number of pushes to events before it. in thread_events: number of pushes to events seen when pushed
+        PlatformSurface::Event e;
+    };
+    mpsc_fifo<Queued, true> events; // from any thread
+    spsc_fifo<Queued> thread_events; // from event_thread
+    atomic<uint64_t> pushed = 0; // to events. only stamped by other threads, the event thread loads it
+    atomic<thread::id> event_thread = {};
+
+    // the earlier pushed head of the 2 fifos, so events are popped in push order. a head of events is earlier if it was counted by the head of thread_events
+    Queued* head() {
+        const auto a = events.front();
+        const auto b = thread_events.front();
+        if (!a || !b)
+            return a ? a : b;
+        return a->seq < b->seq ? a : b;
+    }
+
+    PlatformSurface::Event* front() {
+        const auto q = head();
+        return q ? &q->e : nullptr;
+    }
+
+    bool pop(PlatformSurface::Event* e) {
+        const auto q = head();
+        if (!q)
+            return false;
+        Queued v;
+        if (q == events.front())
+            events.pop(&v);
+        else
+            thread_events.pop(&v);
+        *e = std::move(v.e);
+        return true;
+    }
 };
 
 PlatformSurface::PlatformSurface(Type type)
@@ -122,10 +158,9 @@ PlatformSurface::Type PlatformSurface::type() const
 
 void PlatformSurface::resetNativeHandle(void* handle)
 {
-    if (d->native_handle == handle) // TODO: no check, used to check resize in callback
+    if (d->native_handle.load(memory_order_relaxed) == handle) // TODO: no check, used to check resize in callback
         return;
-    auto old = d->native_handle;
-    d->native_handle = handle;
+    auto old = d->native_handle.exchange(handle, memory_order_acq_rel);
     // NativeHandleEvent must be posted after nativeHandleForGL is valid, before resize
     if (d->handle_cb)
         d->handle_cb(old);
@@ -148,7 +183,7 @@ void PlatformSurface::setNativeHandleChangeCallback(const function<void(void*)>&
 
 void* PlatformSurface::nativeHandle() const
 {
-    return d->native_handle;
+    return d->native_handle.load(memory_order_acquire);
 }
 
 void PlatformSurface::setEventCallback(const function<void()>& cb)
@@ -156,6 +191,11 @@ void PlatformSurface::setEventCallback(const function<void()>& cb)
     d->cb = cb;
 }
 
+void PlatformSurface::setEventThread(std::thread::id id)
+{
+    d->event_thread.store(id, memory_order_relaxed);
+}
+
 void PlatformSurface::resize(int w, int h)
 {
     Event e;
@@ -167,22 +207,40 @@ void PlatformSurface::resize(int w, int h)
 void PlatformSurface::close()
 {
     pushEvent(Event{Event::Close});
-    d->closed = true;
+    d->closed.store(true, memory_order_release);
 }
 
 bool PlatformSurface::popEvent(Event &e)
 {
     // SPSC is enough if events are generated in consumer thread(Produce/Consume is ordered) and at most 1 another thread
-    // but processEvents() is also called in RenderLoop.waitForStopped(), so MPSC is require
+    // but processEvents() is also called in RenderLoop.waitForStopped(), so MPSC is required unless the event thread is fixed, see setEventThread()
     processEvents();
-    return d->events.pop(&e);
+    // events before a pending Close are redundant, the surface and context will be destroyed
+    const bool closing = d->closed.load(memory_order_acquire);
+    while (d->pop(&e)) {
+        if (e.type == Event::Close)
+            return true;
+        if (closing)
+            continue;
+        // only the latest size of consecutive resizes matters, e.g. dragging window border
+        if (e.type == Event::Resize) {
+            const auto next = d->front();
+            if (next && next->type == Event::Resize)
+                continue;
+        }
+        return true;
+    }
+    return false;
 }
 
 void PlatformSurface::pushEvent(Event&& e)
 {
-    if (d->closed) // no pending events for closed surface
+    if (d->closed.load(memory_order_relaxed)) // no pending events for closed surface
         return;
-    d->events.push(std::move(e));
+    if (d->event_thread.load(memory_order_relaxed) == this_thread::get_id()) // no atomic RMW
+        d->thread_events.push({d->pushed.load(memory_order_relaxed), std::move(e)});
+    else
+        d->events.push({d->pushed.fetch_add(1, memory_order_relaxed), std::move(e)});
     // TODO: user listeners
     if (d->cb)
         d->cb();
@@ -10,62 +10,1182 @@
 #include "ugs/RenderLoop.h"
 #include "ugs/PlatformSurface.h"
 #include "base/BlockingQueue.h"
+#include "base/ring_buffer.h"
+#include "base/Task.h"
+#include "base/slot_map.h"
+#include "base/unbounded_blocking_fifo.h"
+#include <atomic>
+#include <algorithm>
 #include <cassert>
-#include <list>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 #include <iostream>
+#if defined(__linux__)
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+# include <unistd.h>
+#endif
 
-//// TODO: frame rendering can be driven by frame push, master clock, vsync, subtitle(hi fps sub, but must < vsync fps), any of above conditions triggered, post update event in render loop
+// frame rendering can be driven by frame push, master clock, vsync, subtitle(hi fps sub, but must < vsync fps). see FrameSource
 UGS_NS_BEGIN
 using namespace std;
 
+// frames of a surface built by onPrepare() in prepare threads
+class FramePipeline {
+public:
+    mutex mtx;
+    bool preparing = false;
+    bool requested = false; // requested again while preparing
+    bool ready = false; // next is not drawn yet
+    uint64_t frames = 0;
+    int width = 0;
+    int height = 0;
+    FrameInfo next;
+};
+
+// state of a surface shared by all threads
+struct SurfaceState {
+    SurfaceState(const shared_ptr<PlatformSurface>& s, int g) : group(g), surface(s) {}
+
+    atomic<uint64_t> handle = 0; // slot_map handle in the worker, 0 if not inserted yet. accessed by the worker only
+    const int group;
+    atomic<int> priority = 0;
+    atomic<chrono::steady_clock::duration::rep> period = 0; // setFrameRate(surface, fps)
+    atomic<bool> queued = false; // process() for events is scheduled and not run yet
+    atomic<bool> dirty = false; // redraw requested by update() and not drawn yet
+    const shared_ptr<PlatformSurface> surface; // alive while a snapshot in any thread holds the state
+};
+
 class RenderLoop::SurfaceContext {
 public:
+    SurfaceContext() = default;
+    SurfaceContext(const shared_ptr<PlatformSurface>& s) : surface(s) {}
+    SurfaceContext(SurfaceContext&&) noexcept = default;
+    SurfaceContext& operator=(SurfaceContext&&) noexcept = default;
+
     shared_ptr<PlatformSurface> surface;
-    RenderContext ctx; // TODO: if use the same context, use shared_ptr, deleter is destroyRenderContext
+    shared_ptr<SurfaceState> state;
+    RenderContext ctx = nullptr;
+    int group = -1; // context group, < 0: not shared
+    shared_ptr<void> shared; // context of the group, ctx is created from it. deleter is destroySharedRenderContext()
+    bool detached = false; // ctx is retained without a native handle, can not draw
+    uint32_t handle_changes = 0; // NativeHandle events. a context created asynchronously for an old handle is dropped
+    chrono::steady_clock::duration cost{}; // moving average of draw time, estimated by frame budget scheduler
+    chrono::steady_clock::time_point deadline{}; // frame budget scheduler, checked when submitted
     int width = 0;
     int height = 0;
+    bool defer_submit = false; // 2 phase present: submit after all surfaces are drawn
+    bool submit_pending = false; // drawn but not submitted
+    shared_ptr<FramePipeline> pipeline; // created on the first onPrepare() request
+    FrameInfo frame; // the latest frame drawn
+};
+// surface and context current in this thread
+struct CurrentContext {
+    const RenderLoop* loop = nullptr;
+    const PlatformSurface* surface = nullptr;
+    RenderContext ctx = nullptr;
 };
+static thread_local CurrentContext current_ctx;
+
 class RenderLoop::Private
 {
 public:
+    Private() {
+        for (size_t i = 0; i < kPinShards; ++i)
+            publish(i, make_shared<const Pins>());
+        setWorkers(1);
+#if defined(__linux__)
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = wake_fd;
+        if (epfd >= 0 && wake_fd >= 0 && epoll_ctl(epfd, EPOLL_CTL_ADD, wake_fd, &ev) == 0)
+            return;
+        clog << "failed to create epoll. fallback to polling native events" << endl;
+        if (epfd >= 0)
+            ::close(epfd);
+        if (wake_fd >= 0)
+            ::close(wake_fd);
+        epfd = wake_fd = -1;
+#endif
+    }
+
     ~Private() {
-        assert(!render_thread.joinable() && "rendering thread can not be joinable in dtor. MUST call stop() & waitForStopped() first");
+        for (const auto& w : workers)
+            assert(!w->render_thread.joinable() && "rendering thread can not be joinable in dtor. MUST call stop() & waitForStopped() first");
+#if defined(__linux__)
+        if (epfd >= 0)
+            ::close(epfd);
+        if (wake_fd >= 0)
+            ::close(wake_fd);
+#endif
+    }
+
+    // a rendering thread. a surface is pinned to 1 worker, so its context is always current in the same thread and its callbacks are ordered
+    class Worker {
+    public:
+        unbounded_blocking_fifo<Task<void()>> tasks; // lock free, nodes are recycled, captures are stored inline. parks only if empty
+        slot_map<SurfaceContext> surfaces; // accessed by this worker only
+        atomic<bool> draw_pending = false;
+        atomic<bool> redraw_all = false; // update() for all surfaces
+        size_t load = 0; // pinned surfaces, including the ones to be inserted. guarded by surfaces_mtx
+        thread render_thread;
+        vector<shared_ptr<SurfaceState>> retired; // states of removed surfaces, released in this thread once no snapshot or task holds them
+        // frame budget scheduler, reused by every pass
+        struct Due {
+            slot_map<SurfaceContext>::handle handle;
+            chrono::steady_clock::time_point deadline;
+            int priority;
+        };
+        vector<Due> due;
+        vector<pair<int, chrono::steady_clock::duration>> levels; // estimated cost of surfaces to be drawn of each priority
+    };
+
+    // a surface pinned to a worker
+    struct Pin : SurfaceState {
+        Pin(const shared_ptr<PlatformSurface>& s, Worker* w, int g) : SurfaceState(s, g), worker(w) {}
+        atomic<Worker*> worker; // changed by migration
+    };
+    // copy on write pins sorted by surface. readers(event, user, prepare and rendering threads) never lock, writers publish a new snapshot with surfaces_mtx locked.
+    // sharded by surface address, so adding or removing a surface copies only 1 shard
+    using Pins = vector<pair<const PlatformSurface*, shared_ptr<Pin>>>;
+    static constexpr size_t kPinShards = 32;
+#if (__cpp_lib_atomic_shared_ptr + 0)
+    using PinShard = atomic<shared_ptr<const Pins>>;
+#else
+    using PinShard = shared_ptr<const Pins>;
+#endif
+
+    // surfaces sharing a context. they are pinned to the same worker because a context can be current in only 1 thread
+    struct ContextGroup {
+        Worker* worker = nullptr;
+        size_t surfaces = 0;
+        weak_ptr<void> ctx; // alive until contexts of all surfaces are destroyed
+    };
+
+    void setWorkers(int n) {
+        workers.clear();
+        for (int i = 0; i < n; ++i)
+            workers.push_back(make_unique<Worker>());
+    }
+
+    void schedule(Worker& w, Task<void()>&& task) {
+        w.tasks.push(std::move(task));
+        // embedded mode: make fd() readable. 1 write until tasks are run by runPending()
+        if (!use_thread && !notified.exchange(true, memory_order_acq_rel))
+            wake();
+    }
+
+    static size_t shardOf(const PlatformSurface* surface) {
+        return size_t((uint64_t(uintptr_t(surface)) * 0x9E3779B97F4A7C15ull) >> 32) % kPinShards;
+    }
+
+    shared_ptr<const Pins> pins(size_t shard) const {
+#if (__cpp_lib_atomic_shared_ptr + 0)
+        return pin_shards[shard].load(memory_order_acquire);
+#else
+        return atomic_load_explicit(&pin_shards[shard], memory_order_acquire);
+#endif
+    }
+
+    // surfaces_mtx MUST be locked, except in ctor
+    void publish(size_t shard, shared_ptr<const Pins>&& list) {
+#if (__cpp_lib_atomic_shared_ptr + 0)
+        pin_shards[shard].store(std::move(list), memory_order_release);
+#else
+        atomic_store_explicit(&pin_shards[shard], std::move(list), memory_order_release);
+#endif
+    }
+
+    static Pins::const_iterator lowerBound(const Pins& list, const PlatformSurface* surface) {
+        return lower_bound(list.begin(), list.end(), surface, [](const auto& e, const PlatformSurface* s) { return less<const PlatformSurface*>()(e.first, s);});
+    }
+
+    shared_ptr<Pin> pinOf(const PlatformSurface* surface) const {
+        const auto list = pins(shardOf(surface));
+        const auto it = lowerBound(*list, surface);
+        return it != list->end() && it->first == surface ? it->second : nullptr;
+    }
+
+    // f(Pin&) for every surface. removed surfaces in the snapshot are alive until f returns
+    template<typename F>
+    void forEachPin(F&& f) const {
+        for (size_t i = 0; i < kPinShards; ++i) {
+            const auto list = pins(i);
+            for (const auto& [s, p] : *list)
+                f(*p);
+        }
+    }
+
+    // pin a new surface to the worker of its context group, or the least loaded worker
+    shared_ptr<Pin> pin(const shared_ptr<PlatformSurface>& surface, int group) {
+        const lock_guard lock(surfaces_mtx);
+        Worker* w = nullptr;
+        if (group >= 0)
+            w = ctx_groups[group].worker;
+        if (!w)
+            w = min_element(workers.begin(), workers.end(), [](const auto& a, const auto& b) { return a->load < b->load;})->get();
+        if (group >= 0) {
+            auto& g = ctx_groups[group];
+            g.worker = w;
+            ++g.surfaces;
+        }
+        ++w->load;
+        auto p = make_shared<Pin>(surface, w, group);
+        const auto shard = shardOf(surface.get());
+        auto list = make_shared<Pins>(*pins(shard));
+        list->emplace(lowerBound(*list, surface.get()), surface.get(), p);
+        publish(shard, std::move(list));
+        nb_surfaces.fetch_add(1, memory_order_acq_rel);
+        return p;
+    }
+
+    // surface in worker w. null if removed, not inserted yet or moved to another worker
+    SurfaceContext* find(Worker& w, const PlatformSurface* surface) {
+        const auto p = pinOf(surface);
+        if (!p || p->worker.load(memory_order_acquire) != &w)
+            return nullptr;
+        return w.surfaces.get(p->handle.load(memory_order_relaxed));
+    }
+
+    // process events and draw the surface in its worker
+    // at most 1 process() of a surface is queued, events arrived before it runs are processed together
+    void post(RenderLoop* loop, const shared_ptr<Pin>& p) {
+        if (p->queued.exchange(true, memory_order_acq_rel))
+            return;
+        const auto w = p->worker.load(memory_order_acquire);
+        schedule(*w, [loop, wp = weak_ptr(p), w]{ // a pending task does not keep a removed surface alive
+            const auto p = wp.lock();
+            if (!p)
+                return;
+            p->queued.store(false, memory_order_release); // events from now on need a new process()
+            if (p->worker.load(memory_order_acquire) != w) // moved to another worker, events are processed when inserted
+                return;
+            const auto sp = w->surfaces.get(p->handle.load(memory_order_relaxed)); // null if removed
+            if (sp && !loop->process(sp)) {
+                clog << "surface removed by event callback..." << endl;
+            }
+        });
+    }
+
+    // insert a surface pinned to w in worker w, then process pending events and draw
+    void adopt(RenderLoop* loop, Worker& w, SurfaceContext&& sc) {
+        const auto h = w.surfaces.emplace(std::move(sc));
+        const auto sp = w.surfaces.get(h);
+        sp->state->handle.store(h, memory_order_relaxed);
+        if (!use_thread) // native events are processed and resize events from submit() are generated only in this thread
+            sp->surface->setEventThread();
+        if (stop_requested) // stop() before inserted
+            sp->surface->close();
+        if (!loop->process(sp)) { // create=>resize=>close event in 1 process()
+            clog << "surface removed by surface add callback..." << endl;
+        }
+    }
+
+    // in the worker of surface
+    void erase(RenderLoop* loop, SurfaceContext& sp) {
+        const auto surface = sp.surface.get();
+        shared_ptr<SurfaceState> state = sp.state;
+        const auto w = pinOf(surface)->worker.load(memory_order_relaxed);
+        w->surfaces.erase(state->handle.load(memory_order_relaxed)); // sp is invalid now
+        Worker* from = nullptr;
+        Worker* to = nullptr;
+        {
+            const lock_guard lock(surfaces_mtx);
+            --w->load;
+            if (const auto g = ctx_groups.find(state->group); g != ctx_groups.end() && --g->second.surfaces == 0)
+                ctx_groups.erase(g);
+            const auto shard = shardOf(surface);
+            auto list = make_shared<Pins>(*pins(shard));
+            list->erase(lowerBound(*list, surface));
+            publish(shard, std::move(list));
+            const auto [lo, hi] = minmax_element(workers.begin(), workers.end(), [](const auto& a, const auto& b) { return a->load < b->load;});
+            if ((*hi)->load > (*lo)->load + 1) {
+                from = hi->get();
+                to = lo->get();
+            }
+        }
+        w->retired.push_back(std::move(state)); // the surface is destroyed in this thread
+        nb_surfaces.fetch_sub(1, memory_order_acq_rel);
+        if (nb_rates > 0) {
+            const lock_guard lock(rates_mtx);
+            if (rates.erase(surface))
+                nb_rates = rates.size();
+        }
+        if (from) {
+            schedule(*from, [this, loop, from, to]{
+                migrate(loop, *from, *to);
+            });
+        }
+    }
+
+    // release states of removed surfaces not referenced by any snapshot or task. the ref count never increases once retired
+    void reclaim(Worker& w) {
+        if (w.retired.empty())
+            return;
+        w.retired.erase(remove_if(w.retired.begin(), w.retired.end(), [](const auto& s) { return s.use_count() == 1;}), w.retired.end());
+    }
+
+    // in worker from. move a surface to worker to if the context can be released from current thread. surfaces sharing a context are not moved
+    void migrate(RenderLoop* loop, Worker& from, Worker& to) {
+        auto it = find_if(make_reverse_iterator(from.surfaces.end()), make_reverse_iterator(from.surfaces.begin()), [](const SurfaceContext& s) { return s.group < 0;});
+        if (it == make_reverse_iterator(from.surfaces.begin()))
+            return;
+        auto& sp = *it;
+        {
+            const lock_guard lock(surfaces_mtx);
+            if (from.load <= to.load + 1) // balanced by add()
+                return;
+        }
+        if (sp.ctx && !loop->releaseRenderContext(sp.surface.get(), sp.ctx))
+            return;
+        resetCurrent();
+        const auto p = pinOf(sp.surface.get());
+        SurfaceContext moved;
+        from.surfaces.erase(p->handle.exchange(0, memory_order_relaxed), &moved);
+        p->worker.store(&to, memory_order_release);
+        {
+            const lock_guard lock(surfaces_mtx);
+            --from.load;
+            ++to.load;
+        }
+        clog << moved.surface.get() << " is moved to another rendering thread" << endl;
+        schedule(to, [this, loop, &to, sc = std::move(moved)]() mutable {
+            adopt(loop, to, std::move(sc));
+        });
+    }
+
+    // skip activateRenderContext() if the surface and context are already current in this thread
+    bool activate(RenderLoop* loop, PlatformSurface* surface, RenderContext ctx) {
+        auto& c = current_ctx;
+        if (ctx && c.ctx == ctx && c.surface == surface && c.loop == loop)
+            return true;
+        c = {};
+        if (!loop->activateRenderContext(surface, ctx))
+            return false;
+        c = {loop, surface, ctx};
+        return true;
+    }
+
+    // after any context hook except activate and submit. it may destroy, release or unbind the current context of this thread, e.g. eglMakeCurrent(EGL_NO_CONTEXT)
+    static void resetCurrent() {
+        current_ctx = {};
+    }
+
+    // keep ctx of a closed surface in the pool if supported. return false if ctx should be destroyed
+    bool recycleContext(RenderLoop* loop, PlatformSurface* surface, RenderContext ctx) {
+        if (pool_size <= 0)
+            return false;
+        const bool detached = loop->detachRenderContext(surface, ctx);
+        resetCurrent();
+        if (!detached)
+            return false;
+        {
+            const lock_guard lock(pool_mtx);
+            ctx_pool.push_front({ctx, surface->nativeResource(), chrono::steady_clock::now()});
+        }
+        trimPool(loop);
+        return true;
+    }
+
+    // the most recently pooled context compatible with surface, attached to surface. null if none
+    RenderContext reuseContext(RenderLoop* loop, PlatformSurface* surface) {
+        if (pool_size <= 0)
+            return nullptr;
+        trimPool(loop);
+        RenderContext ctx = nullptr;
+        {
+            const lock_guard lock(pool_mtx);
+            const auto it = find_if(ctx_pool.begin(), ctx_pool.end(), [res = surface->nativeResource()](const auto& c) { return c.res == res;});
+            if (it != ctx_pool.end()) {
+                ctx = it->ctx;
+                ctx_pool.erase(it);
+            }
+        }
+        if (ctx && !loop->resetRenderContextSurface(surface, ctx)) {
+            loop->destroyRenderContext(nullptr, ctx);
+            ctx = nullptr;
+        }
+        resetCurrent();
+        if (!ctx) {
+            pool_misses.fetch_add(1, memory_order_relaxed);
+            return nullptr;
+        }
+        pool_hits.fetch_add(1, memory_order_relaxed);
+        clog << "reuse pooled render context " << ctx << endl;
+        return ctx;
+    }
+
+    // destroy pooled contexts exceeding the size or idle timeout, or all. pooled contexts are not current in any thread
+    void trimPool(RenderLoop* loop, bool all = false) {
+        vector<RenderContext> expired;
+        {
+            const lock_guard lock(pool_mtx);
+            const auto now = chrono::steady_clock::now();
+            const auto timeout = chrono::milliseconds(pool_timeout.load(memory_order_relaxed));
+            while (!ctx_pool.empty() && (all || ctx_pool.size() > size_t(std::max(pool_size.load(memory_order_relaxed), 0))
+                                        || (timeout.count() > 0 && now - ctx_pool.back().since > timeout))) {
+                expired.push_back(ctx_pool.back().ctx);
+                ctx_pool.pop_back();
+            }
+        }
+        for (const auto ctx : expired)
+            loop->destroyRenderContext(nullptr, ctx);
+        if (!expired.empty())
+            resetCurrent();
+    }
+
+    // ms until the least recently pooled context exceeds the idle timeout, 0 if already expired, -1 if never. event waits are limited by this to trim in time without rendering
+    int poolExpiry() {
+        const auto timeout = chrono::milliseconds(pool_timeout.load(memory_order_relaxed));
+        if (pool_size <= 0 || timeout.count() <= 0)
+            return -1;
+        const lock_guard lock(pool_mtx);
+        if (ctx_pool.empty())
+            return -1;
+        const auto left = ctx_pool.back().since + timeout - chrono::steady_clock::now();
+        if (left.count() < 0)
+            return 0;
+        return int(chrono::duration_cast<chrono::milliseconds>(left).count()) + 1; // expired if idle time > timeout
+    }
+
+    // destroy expired pooled contexts if not rendering. in a rendering thread, i.e. the dispatch() thread if embedded, otherwise the first worker
+    void trimIdlePool(RenderLoop* loop) {
+        if (poolExpiry() != 0)
+            return;
+        if (!use_thread) {
+            trimPool(loop);
+            return;
+        }
+        if (pool_trim_pending.exchange(true, memory_order_acq_rel))
+            return;
+        schedule(*workers[0], [this, loop]{
+            trimPool(loop);
+            pool_trim_pending.store(false, memory_order_release);
+            wake(); // the event thread waits for the next expiry
+        });
+    }
+
+    static int minTimeout(int a, int b) { // -1 is infinite
+        if (a < 0)
+            return b;
+        return b < 0 ? a : std::min(a, b);
+    }
+
+    // in the worker of the group. return null if not shared or not supported
+    shared_ptr<void> sharedContext(RenderLoop* loop, PlatformSurface* surface, int group) {
+        if (group < 0)
+            return nullptr;
+        shared_ptr<void> ctx;
+        {
+            const lock_guard lock(surfaces_mtx);
+            ctx = ctx_groups[group].ctx.lock();
+        }
+        if (ctx)
+            return ctx;
+        const auto c = loop->createSharedRenderContext(surface);
+        resetCurrent();
+        if (!c)
+            return nullptr;
+        clog << "shared render context " << c << " is created for group " << group << endl;
+        ctx = shared_ptr<void>(c, [loop](void* c) {
+            clog << "destroying shared render context " << c << endl;
+            loop->destroySharedRenderContext(c);
+            resetCurrent();
+        });
+        const lock_guard lock(surfaces_mtx);
+        ctx_groups[group].ctx = ctx;
+        return ctx;
+    }
+
+    void render(RenderLoop* loop, Worker& w) {
+        w.draw_pending.store(false, memory_order_release); // requests from now on need a new pass
+        const bool all = w.redraw_all.exchange(false, memory_order_acq_rel);
+        auto& surfaces = w.surfaces;
+        if (pool_size > 0) // idle timeout
+            trimPool(loop);
+        // surfaces sharing a context are drawn one after another to minimize context switches. sorted again only if contexts are changed
+        const auto by_ctx = [](const SurfaceContext& a, const SurfaceContext& b) {
+            const auto ka = a.shared ? a.shared.get() : a.ctx;
+            const auto kb = b.shared ? b.shared.get() : b.ctx;
+            return less<RenderContext>()(ka, kb);
+        };
+        if (!is_sorted(surfaces.begin(), surfaces.end(), by_ctx))
+            surfaces.sort(by_ctx);
+        if (budget.load(memory_order_relaxed) > 0 && !prepare_cb) {
+            renderByDeadline(loop, w, all);
+        } else {
+            for (size_t i = 0; i < surfaces.size();) {
+                const bool dirty = surfaces[i].state->dirty.exchange(false, memory_order_acq_rel);
+                if (!dirty && (!all || (nb_rates > 0 && deferToRate(surfaces[i].surface.get())))) {
+                    ++i;
+                } else if (prepare_cb) {
+                    prepare(loop, surfaces[i]);
+                    ++i;
+                } else {
+                    surfaces[i].defer_submit = two_phase;
+                    if (loop->process(&surfaces[i]))
+                        ++i;
+                }
+                // else: removed, the last surface is moved to i and will be drawn in this pass
+            }
+        }
+        if (!two_phase)
+            return;
+        // all draws are issued, then swaps blocked by vsync or flow control will not delay other surfaces.
+        // serial in this thread because a swap requires its context current, only other workers run in parallel
+        for (auto& sp : surfaces) {
+            if (!exchange(sp.submit_pending, false))
+                continue;
+            const auto surface = sp.surface.get();
+            if (!surface->acquire())
+                continue;
+            activate(loop, surface, sp.ctx);
+            submit(loop, sp);
+            surface->release();
+        }
+    }
+
+    /*
+     * earliest deadline first. the deadline of a surface is pass start + its frame period, or + budget if no frame rate. equal deadlines are ordered by priority.
+     * a surface is skipped if its estimated draw time does not fit the budget, with the time reserved for remaining surfaces of higher priority.
+     * surfaces of the highest priority in the pass are never skipped
+     */
+    void renderByDeadline(RenderLoop* loop, Worker& w, bool all) {
+        using namespace chrono;
+        auto& surfaces = w.surfaces;
+        const auto start = steady_clock::now();
+        const auto budget_time = duration_cast<steady_clock::duration>(duration<float, milli>(budget.load(memory_order_relaxed)));
+        w.due.clear();
+        w.levels.clear();
+        for (size_t i = 0; i < surfaces.size(); ++i) {
+            auto& sp = surfaces[i];
+            const bool dirty = sp.state->dirty.exchange(false, memory_order_acq_rel);
+            if (!dirty && (!all || (nb_rates > 0 && deferToRate(sp.surface.get()))))
+                continue;
+            const steady_clock::duration period(sp.state->period.load(memory_order_relaxed));
+            const int priority = sp.state->priority.load(memory_order_relaxed);
+            w.due.push_back({surfaces.handle_at(i), start + (period.count() > 0 ? period : budget_time), priority});
+            auto level = find_if(w.levels.begin(), w.levels.end(), [&](const auto& l) { return l.first == priority;});
+            if (level == w.levels.end())
+                level = w.levels.insert(w.levels.end(), {priority, {}});
+            level->second += sp.cost;
+        }
+        if (w.due.empty())
+            return;
+        sort(w.due.begin(), w.due.end(), [](const auto& a, const auto& b) {
+            return a.deadline < b.deadline || (a.deadline == b.deadline && a.priority > b.priority);
+        });
+        const auto top = max_element(w.levels.begin(), w.levels.end())->first;
+        for (const auto& due : w.due) {
+            auto sp = surfaces.get(due.handle);
+            if (!sp) // removed by a previous surface
+                continue;
+            auto level = find_if(w.levels.begin(), w.levels.end(), [&](const auto& l) { return l.first == due.priority;});
+            level->second -= sp->cost;
+            if (due.priority < top) {
+                auto reserved = sp->cost;
+                for (const auto& l : w.levels) {
+                    if (l.first > due.priority)
+                        reserved += l.second;
+                }
+                if (steady_clock::now() - start + reserved > budget_time) {
+                    skipped.fetch_add(1, memory_order_relaxed);
+                    sp->state->dirty.store(true, memory_order_release); // still due, drawn in the next pass
+                    continue;
+                }
+            }
+            const auto t = steady_clock::now();
+            sp->deadline = due.deadline;
+            sp->defer_submit = two_phase;
+            if (!loop->process(sp))
+                continue;
+            sp = surfaces.get(due.handle);
+            if (!sp->submit_pending) // submitted, or not drawn
+                sp->deadline = {};
+            const auto cost = steady_clock::now() - t;
+            sp->cost = sp->cost.count() == 0 ? cost : (sp->cost * 7 + cost) / 8;
+        }
+    }
+
+    // context MUST be current
+    void submit(RenderLoop* loop, SurfaceContext& sp) {
+        const auto surface = sp.surface.get();
+        int changes = 0;
+        loop->submitRenderContext(surface, sp.ctx, &changes); // TODO: recreate context if false(device lost)?
+        surface->submit();
+        frames.fetch_add(1, memory_order_relaxed);
+        if (sp.deadline != chrono::steady_clock::time_point{}) {
+            const auto late = chrono::steady_clock::now() - exchange(sp.deadline, {});
+            if (late.count() > 0) {
+                missed.fetch_add(1, memory_order_relaxed);
+                if (deadline_missed_cb)
+                    deadline_missed_cb(surface, chrono::duration_cast<chrono::microseconds>(late).count());
+            }
+        }
+        if (changes && sp.width > 0 && sp.height > 0) // surface->size() in thread may be not allowed
+            surface->PlatformSurface::resize(sp.width, sp.height);
+    }
+
+    // request a frame of the surface from onPrepare() in prepare threads. merged if a frame of the surface is being prepared
+    void prepare(RenderLoop* loop, SurfaceContext& sp) {
+        if (!sp.pipeline)
+            sp.pipeline = make_shared<FramePipeline>();
+        {
+            const lock_guard lock(sp.pipeline->mtx);
+            sp.pipeline->width = sp.width;
+            sp.pipeline->height = sp.height;
+            if (sp.pipeline->preparing) {
+                sp.pipeline->requested = true;
+                return;
+            }
+            sp.pipeline->preparing = true;
+        }
+        prepareAsync(loop, static_pointer_cast<Pin>(sp.state), sp.pipeline);
+    }
+
+    // the pin keeps the surface alive, and is always handed back to the worker by present()
+    void prepareAsync(RenderLoop* loop, shared_ptr<Pin> pin, const shared_ptr<FramePipeline>& p) {
+        prepare_tasks.push([this, loop, pin = std::move(pin), p]() mutable {
+            const auto surface = pin->surface.get();
+            FrameInfo frame;
+            bool removed = false;
+            {
+                const lock_guard lock(p->mtx);
+                removed = !pinOf(surface);
+                if (removed) {
+                    p->preparing = p->requested = false;
+                } else {
+                    frame.number = ++p->frames;
+                    frame.width = p->width;
+                    frame.height = p->height;
+                }
+            }
+            if (!removed) {
+                prepare_cb(surface, frame);
+                bool again = false;
+                {
+                    const lock_guard lock(p->mtx);
+                    p->next = std::move(frame); // drop the previous one if not drawn
+                    p->ready = true;
+                    again = exchange(p->requested, false);
+                    p->preparing = again;
+                }
+                if (again) // frame N+1 is prepared while frame N is drawn
+                    prepareAsync(loop, pin, p);
+            }
+            present(loop, std::move(pin));
+        });
+    }
+
+    // draw the prepared frame in the worker of the surface. the pin is released in worker, so a removed surface is destroyed there by reclaim()
+    void present(RenderLoop* loop, shared_ptr<Pin>&& pin) {
+        const auto w = pin->worker.load(memory_order_acquire);
+        schedule(*w, [this, loop, w, pin = std::move(pin)]{
+            const auto sp = find(*w, pin->surface.get());
+            if (!sp || !sp->pipeline) // removed, or moved to another worker and drawn by the next process()
+                return;
+            {
+                const lock_guard lock(sp->pipeline->mtx);
+                if (!sp->pipeline->ready) // already drawn by process() for events
+                    return;
+            }
+            if (!loop->process(sp)) {
+                clog << "surface removed when drawing a prepared frame..." << endl;
+            }
+        });
     }
-    void schedule(std::function<void()>&& task) {
-        tasks.push(std::move(task));
+
+    // create a context for the native handle of the surface in a prepare thread, then attach it in the worker of the surface
+    void createContextAsync(RenderLoop* loop, shared_ptr<Pin> pin, uint32_t handle_changes) {
+        prepare_tasks.push([this, loop, pin = std::move(pin), handle_changes]() mutable {
+            const auto ctx = loop->createRenderContext(pin->surface.get());
+            attach(loop, std::move(pin), handle_changes, ctx);
+        });
     }
 
-    void run() {
-        running = true;
+    // the pin is released in the worker, so a removed surface is destroyed there by reclaim()
+    void attach(RenderLoop* loop, shared_ptr<Pin>&& pin, uint32_t handle_changes, RenderContext ctx) {
+        const auto w = pin->worker.load(memory_order_acquire);
+        schedule(*w, [this, loop, w, pin = std::move(pin), handle_changes, ctx]() mutable {
+            const auto s = pin->surface.get(); // not a new reference, which could be the last one
+            const auto sp = find(*w, s);
+            if (!sp) {
+                if (pinOf(s)) { // moved to another worker
+                    attach(loop, std::move(pin), handle_changes, ctx);
+                    return;
+                }
+                if (ctx) { // removed. ctx is never current
+                    loop->destroyRenderContext(s, ctx);
+                    resetCurrent();
+                }
+                return;
+            }
+            if (sp->handle_changes != handle_changes || sp->ctx) { // native handle is changed again
+                if (ctx) {
+                    loop->destroyRenderContext(s, ctx);
+                    resetCurrent();
+                }
+                return;
+            }
+            if (!ctx) {
+                std::clog << "ERROR! Failed to create rendering context! platform surface handle: " << s->nativeHandle() << std::endl;
+                return;
+            }
+            if (ctx_created_cb)
+                ctx_created_cb(s, ctx);
+            sp->ctx = ctx;
+            if (!loop->process(sp)) {
+                clog << "surface removed after context is created..." << endl;
+            }
+        });
+    }
+
+    void startPreparers() {
+        if ((!prepare_cb && !async_ctx) || !preparers.empty())
+            return;
+        const int n = std::max<int>(1, int(thread::hardware_concurrency()) - int(workers.size()));
+        for (int i = 0; i < n; ++i) {
+            preparers.emplace_back([this]{
+                while (true) {
+                    Task<void()> task;
+                    prepare_tasks.pop(task);
+                    if (!task) // stopPreparers()
+                        break;
+                    task();
+                }
+            });
+        }
+    }
+
+    void stopPreparers() {
+        for (size_t i = 0; i < preparers.size(); ++i)
+            prepare_tasks.push(Task<void()>());
+        for (auto& t : preparers)
+            t.join();
+        preparers.clear();
+    }
+
+    // mark the surface(all if null) dirty, and schedule a draw pass in its worker(all workers if null) if none is pending. requests from update() and all frame sources are merged
+    void update(RenderLoop* loop, const PlatformSurface* surface = nullptr) {
+        Worker* target = nullptr;
+        if (surface && nb_rates > 0 && deferToRate(surface)) { // drawn at its own deadline
+            ++coalesced;
+            return;
+        }
+        if (surface) {
+            const auto p = pinOf(surface);
+            if (!p) // removed
+                return;
+            p->dirty.store(true, memory_order_release);
+            target = p->worker.load(memory_order_acquire);
+        }
+        bool scheduled = false;
+        for (const auto& w : workers) {
+            if (target && w.get() != target)
+                continue;
+            if (!surface)
+                w->redraw_all.store(true, memory_order_release);
+            if (w->draw_pending.exchange(true, memory_order_acq_rel))
+                continue;
+            scheduled = true;
+            schedule(*w, [this, loop, w = w.get()]{
+                const auto f = frames.load(memory_order_relaxed);
+                render(loop, *w);
+                if (frames.load(memory_order_relaxed) == f) // sources waiting for presented() can re-arm
+                    notifyIdle();
+            });
+        }
+        if (!scheduled)
+            ++coalesced;
+    }
+
+    // mark surfaces dirty in 1 batch, then schedule a draw pass in each of their workers if none is pending. so surfaces due at the same time are drawn in the same pass
+    // targets is a buffer of the caller reused to avoid allocation
+    void update(RenderLoop* loop, const vector<const PlatformSurface*>& surfaces, vector<Worker*>& targets) {
+        targets.clear();
+        for (const auto s : surfaces) {
+            const auto p = pinOf(s);
+            if (!p)
+                continue;
+            p->dirty.store(true, memory_order_release);
+            const auto w = p->worker.load(memory_order_acquire);
+            if (std::find(targets.cbegin(), targets.cend(), w) == targets.cend())
+                targets.push_back(w);
+        }
+        bool scheduled = false;
+        for (const auto w : targets) {
+            if (w->draw_pending.exchange(true, memory_order_acq_rel))
+                continue;
+            scheduled = true;
+            schedule(*w, [this, loop, w]{
+                render(loop, *w);
+            });
+        }
+        if (!scheduled && !targets.empty())
+            ++coalesced;
+    }
+
+    // return false if surface has no frame rate. otherwise the request is recorded and drawn at the next deadline of surface if rate limited
+    bool deferToRate(const PlatformSurface* surface) {
+        const lock_guard lock(rates_mtx);
+        const auto it = rates.find(surface);
+        if (it == rates.end())
+            return false;
+        it->second.requested = true;
+        return true;
+    }
+
+    void setRate(RenderLoop* loop, const PlatformSurface* surface, float fps, bool limit_only) {
+        {
+            const lock_guard lock(rates_mtx);
+            if (fps <= 0) {
+                rates.erase(surface);
+            } else {
+                auto& r = rates[surface];
+                r.period = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(1.0 / fps));
+                r.n = (chrono::steady_clock::now() - rates_t0) / r.period + 1;
+                r.limit_only = limit_only;
+            }
+            nb_rates = rates.size();
+        }
+        if (const auto p = pinOf(surface))
+            p->period.store(fps > 0 ? chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(1.0 / fps)).count() : 0, memory_order_relaxed);
+        rates_cv.notify_one();
+        if (running)
+            startRates(loop);
+    }
+
+    void startRates(RenderLoop* loop) {
+        const lock_guard lock(rates_mtx);
+        if (rates.empty() || rate_thread.joinable())
+            return;
+        rates_stop = false;
+        rate_thread = thread([this, loop]{
+            runRates(loop);
+        });
+    }
+
+    void stopRates() {
+        {
+            const lock_guard lock(rates_mtx);
+            rates_stop = true;
+        }
+        rates_cv.notify_one();
+        if (rate_thread.joinable())
+            rate_thread.join();
+    }
+
+    // wait for the earliest deadline of all surfaces, then draw every surface due in the same pass. deadlines are t0 + n * period of a surface, missed ones are skipped
+    void runRates(RenderLoop* loop) {
+        using namespace chrono;
+        constexpr auto kBatchWindow = milliseconds(1); // deadlines this close are merged, e.g. rounding errors of 60fps and 15fps
+        vector<const PlatformSurface*> due;
+        vector<Worker*> targets;
+        unique_lock lock(rates_mtx);
+        while (!rates_stop) {
+            auto next = steady_clock::time_point::max();
+            for (const auto& [s, r] : rates)
+                next = std::min(next, rates_t0 + r.period * r.n);
+            if (next == steady_clock::time_point::max())
+                rates_cv.wait(lock);
+            else
+                rates_cv.wait_until(lock, next);
+            const auto now = steady_clock::now();
+            due.clear();
+            for (auto& [s, r] : rates) {
+                if (rates_t0 + r.period * r.n > now + kBatchWindow)
+                    continue;
+                if (!r.limit_only || r.requested)
+                    due.push_back(s);
+                r.requested = false;
+                r.n = std::max<int64_t>(r.n + 1, (now - rates_t0) / r.period + 1);
+            }
+            if (due.empty())
+                continue;
+            lock.unlock();
+            update(loop, due, targets);
+            lock.lock();
+        }
+    }
+
+    void startSources() {
+        const lock_guard lock(sources_mtx);
+        if (sources_started)
+            return;
+        sources_started = true;
+        for (const auto& s : sources)
+            s->start();
+    }
+
+    void stopSources() {
+        const lock_guard lock(sources_mtx);
+        if (!sources_started)
+            return;
+        sources_started = false;
+        for (const auto& s : sources)
+            s->stop();
+    }
+
+    void notifyPresented() {
+        const auto f = frames.load(memory_order_relaxed);
+        if (frames_notified.exchange(f, memory_order_relaxed) == f)
+            return;
+        const lock_guard lock(sources_mtx);
+        for (const auto& s : sources)
+            s->presented();
+    }
+
+    void notifyIdle() {
+        const lock_guard lock(sources_mtx);
+        for (const auto& s : sources)
+            s->idle();
+    }
+
+    // native event fd of surface is watched by waitForStopped(). surfaces of the same display share 1 fd
+    void watch(PlatformSurface* surface) {
+        const int fd = surface->eventFd();
+        const lock_guard lock(fds_mtx);
+        if (fd < 0 || epfd < 0) {
+            ++unwatched;
+            wake(); // waitForStopped() switches to polling
+            return;
+        }
+        for (auto& [f, refs] : fds) {
+            if (f == fd) {
+                ++refs;
+                return;
+            }
+        }
+        fds.emplace_back(fd, 1);
+#if defined(__linux__)
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+#endif
+    }
+
+    void unwatch(PlatformSurface* surface) {
+        const int fd = surface->eventFd();
+        const lock_guard lock(fds_mtx);
+        if (fd < 0 || epfd < 0) {
+            --unwatched;
+            return;
+        }
+        for (auto it = fds.begin(); it != fds.end(); ++it) {
+            if (it->first != fd || --it->second > 0)
+                continue;
+            fds.erase(it);
+#if defined(__linux__)
+            epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+            return;
+        }
+    }
+
+    // wake up waitEvents()
+    void wake() {
+#if defined(__linux__)
+        if (wake_fd >= 0) {
+            const uint64_t v = 1;
+            (void)!::write(wake_fd, &v, sizeof(v));
+        }
+#endif
+    }
+
+    void clearWake() {
+#if defined(__linux__)
+        uint64_t v = 0;
+        (void)!::read(wake_fd, &v, sizeof(v));
+#endif
+    }
+
+    // block until native events arrive or woken up, at most timeout ms if >= 0. poll every 10ms if any surface has no event fd
+    void waitEvents(int timeout = -1) {
+        const int poll_interval = 10;
+        if (!pool_trim_pending.load(memory_order_acquire))
+            timeout = minTimeout(timeout, poolExpiry());
+        if (unwatched > 0 && (timeout < 0 || timeout > poll_interval))
+            timeout = poll_interval;
+#if defined(__linux__)
+        if (epfd >= 0) {
+            if (timeout != 0 && eventsQueued()) // fd is not readable for them
+                timeout = 0;
+            epoll_event evs[16];
+            const int n = epoll_wait(epfd, evs, int(std::size(evs)), timeout);
+            for (int i = 0; i < n; ++i) {
+                if (evs[i].data.fd == wake_fd)
+                    clearWake();
+            }
+            return;
+        }
+#endif
+        this_thread::sleep_for(chrono::milliseconds(timeout < 0 ? poll_interval : timeout));
+    }
+
+    bool eventsQueued() const {
+        bool queued = false;
+        forEachPin([&](const Pin& p) {
+            queued = queued || p.surface->eventsQueued();
+        });
+        return queued;
+    }
+
+    void processEvents() {
+        forEachPin([](const Pin& p) {
+            p.surface->processEvents(); // MPSC if not embedded
+        });
+    }
+
+    // return false if render loop should exit
+    bool exec(Worker& w, Task<void()>& task) {
+        if (task)
+            task();
+        task = nullptr; // captured surface state may be retired
+        notifyPresented();
+        reclaim(w);
+        return !stop_requested || nb_surfaces.load(memory_order_acquire) > 0;
+    }
+
+    void finish() {
+        stopRates();
+        stopSources();
+        stopPreparers();
+        for (const auto& w : workers)
+            w->retired.clear();
+        running = false;
+        wake();
+    }
+
+    void run(Worker& w) {
         std::clog << this << " start RenderLoop" << std::endl;
-        while (true) { // TODO: lock free? semaphore?
-            function<void()> task;
-            tasks.pop(task);
-            if (task)
-                task();
-            if (stop_requested && surfaces.empty())
+        while (true) {
+            Task<void()> task;
+            w.tasks.pop(&task);
+            if (!exec(w, task))
                 break;
         }
-        running = false;
+        for (const auto& other : workers) { // wake up idle workers to exit
+            if (other.get() != &w)
+                other->tasks.push(nullptr);
+        }
+        if (active_workers.fetch_sub(1, memory_order_acq_rel) == 1)
+            finish();
+    }
+
+    // embedded mode
+    int dispatch(int timeout) {
+        int n = 0;
+        if (epfd >= 0) {
+            if (!notified)
+                waitEvents(timeout);
+        } else if (timeout != 0) { // wait for a task, and poll native events every 10ms
+            Task<void()> task;
+            if (workers[0]->tasks.pop_for(&task, chrono::milliseconds(minTimeout(minTimeout(timeout, 10), poolExpiry())))) {
+                ++n;
+                if (!exec(*workers[0], task)) {
+                    finish();
+                    return n;
+                }
+            }
+        }
+        processEvents();
+        return n + runPending();
+    }
+
+    int runPending() {
+        if (!running)
+            return 0;
+        notified.store(false, memory_order_release); // tasks scheduled from now on will wake fd again
+        clearWake();
+        int n = 0;
+        Task<void()> task;
+        while (workers[0]->tasks.try_pop(&task)) {
+            ++n;
+            if (!exec(*workers[0], task)) {
+                finish();
+                break;
+            }
+        }
+        return n;
     }
 
     bool use_thread = true;
-    bool stop_requested = false;
-    bool running = false;
+    atomic<bool> notified = false; // embedded mode, wake_fd is written
+    atomic<bool> stop_requested = false;
+    atomic<bool> running = false;
     bool stop_on_last_close = true;
-    mutex mtx;
-    thread render_thread;
+    bool two_phase = false;
+    bool async_ctx = false;
+    atomic<uint64_t> coalesced = 0;
+    atomic<float> budget = 0; // ms
+    atomic<uint64_t> skipped = 0;
+    atomic<uint64_t> missed = 0;
+    atomic<uint64_t> frames = 0; // presented frames of all surfaces
+    atomic<uint64_t> frames_notified = 0;
+    vector<unique_ptr<Worker>> workers; // fixed once started. embedded mode has only 1 worker run by dispatch()
+    atomic<size_t> active_workers = 0;
+
+    bool sources_started = false;
+    mutex sources_mtx;
+    vector<shared_ptr<FrameSource>> sources;
+    shared_ptr<FrameSource> rate_source; // setFrameRate()
 
-    list<RenderLoop::SurfaceContext*> surfaces;
+    int epfd = -1;
+    int wake_fd = -1;
+    atomic<int> unwatched = 0; // surfaces without event fd
+    mutex fds_mtx;
+    vector<pair<int, int>> fds; // fd, surfaces
+
+    mutex surfaces_mtx; // writers only: pin map, worker load and context groups
+    PinShard pin_shards[kPinShards];
+    unordered_map<int, ContextGroup> ctx_groups; // guarded by surfaces_mtx
+    struct PooledContext {
+        RenderContext ctx;
+        void* res; // nativeResource() of the surface, reused by surfaces of the same resource
+        chrono::steady_clock::time_point since;
+    };
+    mutex pool_mtx;
+    deque<PooledContext> ctx_pool; // detached contexts of closed surfaces, most recently used first
+    atomic<int> pool_size = 0;
+    atomic<int> pool_timeout = 0;
+    atomic<bool> pool_trim_pending = false; // trimIdlePool() is scheduled in a worker
+    atomic<uint64_t> pool_hits = 0;
+    atomic<uint64_t> pool_misses = 0;
+
+    // per surface frame rate, see RenderLoop::setFrameRate(surface, fps)
+    struct SurfaceRate {
+        chrono::steady_clock::duration period{};
+        int64_t n = 0; // next deadline is rates_t0 + period * n
+        bool limit_only = false;
+        bool requested = false; // redraw requested since the previous deadline
+    };
+    mutex rates_mtx;
+    condition_variable rates_cv;
+    unordered_map<const PlatformSurface*, SurfaceRate> rates;
+    atomic<size_t> nb_rates = 0;
+    const chrono::steady_clock::time_point rates_t0 = chrono::steady_clock::now(); // time base of all surfaces, so deadlines of multiple rates are aligned
+    bool rates_stop = true;
+    thread rate_thread;
+    int default_group = -1; // context group of add(surface)
+    atomic<size_t> nb_surfaces = 0; // including surfaces to be inserted
     function<void(PlatformSurface*,int,int, RenderContext)> resize_cb = nullptr;
-    function<bool(PlatformSurface*, RenderContext)> draw_cb = nullptr;
+    function<bool(PlatformSurface*, RenderContext, const FrameInfo&)> draw_cb = nullptr;
+    function<void(PlatformSurface*, FrameInfo&)> prepare_cb = nullptr;
+    vector<thread> preparers;
+    BlockingQueue<Task<void()>, ring_buffer> prepare_tasks; // MPMC. onPrepare() and async context creation
     function<void(PlatformSurface*)> close_cb = nullptr;
     function<void(PlatformSurface*, RenderContext)> ctx_created_cb = nullptr;
     function<void(PlatformSurface*, RenderContext)> ctx_destroy_cb = nullptr;
-private:
-    BlockingQueue<function<void()>> tasks; // TODO: unbounded_blocking_fifo w/ or w/o semaphore (depending on on draw call cost(profile))
+    function<void(PlatformSurface*, RenderContext)> surface_changed_cb = nullptr;
+    function<void(PlatformSurface*, int64_t)> deadline_missed_cb = nullptr;
 };
 
 RenderLoop::RenderLoop()
@@ -76,6 +1196,9 @@ RenderLoop::RenderLoop()
 RenderLoop::~RenderLoop()
 {
     // can not stop and waitForStopped() in dtor to avoid calling virtual functions. user MUST manually cal them
+    d->stopSources();
+    for (const auto& s : d->sources)
+        s->setTrigger(nullptr);
     delete d;
 }
 
@@ -85,12 +1208,18 @@ bool RenderLoop::start(bool stop_on_last_surface_closed)
         return true;
     d->running = true;
     d->stop_on_last_close = stop_on_last_surface_closed;
+    d->startPreparers();
     if (d->use_thread) { // check joinable?
-        d->render_thread = std::thread([this]{
-            std::clog << "Rendering thread @" << std::this_thread::get_id() << std::endl;
-            d->run();
-        });
+        d->active_workers = d->workers.size();
+        for (const auto& w : d->workers) {
+            w->render_thread = std::thread([this, w = w.get()]{
+                std::clog << "Rendering thread @" << std::this_thread::get_id() << std::endl;
+                d->run(*w);
+            });
+        }
     }
+    d->startSources();
+    d->startRates(this);
     return true;
 }
 
@@ -99,33 +1228,106 @@ void RenderLoop::stop()
     if (!isRunning())
         return;
     d->stop_requested = true;
-    // call once per loop, so no lock
-    const unique_lock lock(d->mtx);
-    for (auto sp : d->surfaces) {
-        sp->surface->close();
-    }
+    d->forEachPin([](const Private::Pin& p) {
+        p.surface->close();
+    });
 }
 
 void RenderLoop::waitForStopped()
 {
     if (!d->use_thread) {
-        d->run();
+        while (d->running)
+            dispatch(-1);
+        d->trimPool(this, true);
         return;
     }
     while (d->running) {
-        {
-            const unique_lock lock(d->mtx);
-            // surfaces.erase() on close.
-            // TODO: lock free, schedule a task so in the same thread as ease(still has mutext in task queue)? main thread?
-            // cow?
-            for (auto sp : d->surfaces) {
-                sp->surface->processEvents(); // MPSC
-            }
-        }
-        this_thread::sleep_for(chrono::milliseconds(10)); // TODO: poll native events?
+        d->processEvents();
+        d->waitEvents();
+        if (d->pool_size > 0) // idle timeout if not rendering
+            d->trimIdlePool(this);
+    }
+    for (const auto& w : d->workers) {
+        if (w->render_thread.joinable())
+            w->render_thread.join();
     }
-    if (d->render_thread.joinable())
-        d->render_thread.join();
+    d->stopSources();
+    d->trimPool(this, true);
+}
+
+void RenderLoop::setEmbedded(bool value)
+{
+    assert(!d->running && "setEmbedded() MUST be called before start()");
+    d->use_thread = !value;
+    if (value && d->workers.size() > 1)
+        d->setWorkers(1);
+}
+
+void RenderLoop::setTwoPhasePresent(bool value)
+{
+    assert(!d->running && "setTwoPhasePresent() MUST be called before start()");
+    d->two_phase = value;
+}
+
+void RenderLoop::setContextPool(int size, int idleTimeout)
+{
+    d->pool_size = size;
+    d->pool_timeout = idleTimeout;
+}
+
+uint64_t RenderLoop::contextPoolHits() const
+{
+    return d->pool_hits;
+}
+
+uint64_t RenderLoop::contextPoolMisses() const
+{
+    return d->pool_misses;
+}
+
+void RenderLoop::setAsyncContextCreation(bool value)
+{
+    assert(!d->running && "setAsyncContextCreation() MUST be called before start()");
+    d->async_ctx = value;
+}
+
+void RenderLoop::setSharedContext(bool value)
+{
+    d->default_group = value ? 0 : -1;
+}
+
+void RenderLoop::setRenderThreads(int n)
+{
+    assert(!d->running && d->nb_surfaces == 0 && "setRenderThreads() MUST be called before start() and add()");
+    if (!d->use_thread) {
+        clog << "embedded mode has only 1 rendering thread" << endl;
+        return;
+    }
+    d->setWorkers(std::max(n, 1));
+}
+
+int RenderLoop::fd() const
+{
+    if (d->use_thread)
+        return -1;
+    return d->epfd;
+}
+
+int RenderLoop::dispatch(int timeout)
+{
+    if (d->use_thread || !d->running)
+        return 0;
+    const int n = d->dispatch(timeout);
+    if (d->pool_size > 0) // idle timeout if not rendering
+        d->trimIdlePool(this);
+    return n;
+}
+
+int RenderLoop::runPending()
+{
+    if (d->use_thread)
+        return 0;
+    return d->runPending();
 }
 
 bool RenderLoop::isRunning() const
@@ -135,15 +1337,92 @@ bool RenderLoop::isRunning() const
 
 void RenderLoop::update()
 {
-    d->schedule([this]{
-        // TODO: lock? what if add(surface) now?
-        for (auto sp : d->surfaces) {
-            if (!process(sp)) {
-                clog << "surface removed, skip current update" << endl;
-                break;
-            }
-        }
+    d->update(this);
+}
+
+void RenderLoop::update(const weak_ptr<PlatformSurface>& surface)
+{
+    const auto s = surface.lock();
+    if (!s)
+        return;
+    d->update(this, s.get());
+}
+
+void RenderLoop::setFrameRate(float fps)
+{
+    if (d->rate_source)
+        removeFrameSource(d->rate_source);
+    d->rate_source.reset();
+    if (fps < 0)
+        d->rate_source = make_shared<VSyncFrameSource>();
+    else if (fps > 0)
+        d->rate_source = make_shared<TimerFrameSource>(fps);
+    if (d->rate_source)
+        addFrameSource(d->rate_source);
+}
+
+void RenderLoop::setFrameRate(const weak_ptr<PlatformSurface>& surface, float fps, bool limitOnly)
+{
+    const auto s = surface.lock();
+    if (!s)
+        return;
+    d->setRate(this, s.get(), fps, limitOnly);
+}
+
+void RenderLoop::setFrameBudget(float ms)
+{
+    d->budget = ms;
+}
+
+void RenderLoop::setPriority(const weak_ptr<PlatformSurface>& surface, int priority)
+{
+    const auto s = surface.lock();
+    if (!s)
+        return;
+    if (const auto p = d->pinOf(s.get()))
+        p->priority.store(priority, memory_order_relaxed);
+}
+
+uint64_t RenderLoop::skippedFrames() const
+{
+    return d->skipped;
+}
+
+uint64_t RenderLoop::missedDeadlines() const
+{
+    return d->missed;
+}
+
+uint64_t RenderLoop::coalescedUpdates() const
+{
+    return d->coalesced;
+}
+
+void RenderLoop::addFrameSource(const shared_ptr<FrameSource>& source)
+{
+    if (!source)
+        return;
+    source->setTrigger([this]{
+        d->update(this);
     });
+    const lock_guard lock(d->sources_mtx);
+    d->sources.push_back(source);
+    if (d->sources_started)
+        source->start();
+}
+
+void RenderLoop::removeFrameSource(const shared_ptr<FrameSource>& source)
+{
+    {
+        const lock_guard lock(d->sources_mtx);
+        const auto it = find(d->sources.cbegin(), d->sources.cend(), source);
+        if (it == d->sources.cend())
+            return;
+        d->sources.erase(it);
+        if (d->sources_started)
+            source->stop();
+    }
+    source->setTrigger(nullptr);
 }
 
 RenderLoop& RenderLoop::onResize(const function<void(PlatformSurface*,int,int,RenderContext)>& cb)
@@ -153,11 +1432,30 @@ RenderLoop& RenderLoop::onResize(const function<void(PlatformSurface*,int,int,Re
 }
 
 RenderLoop& RenderLoop::onDraw(const function<bool(PlatformSurface*, RenderContext)>& cb)
+{
+    if (!cb) {
+        d->draw_cb = nullptr;
+        return *this;
+    }
+    d->draw_cb = [cb](PlatformSurface* surface, RenderContext ctx, const FrameInfo&) {
+        return cb(surface, ctx);
+    };
+    return *this;
+}
+
+RenderLoop& RenderLoop::onDraw(const function<bool(PlatformSurface*, RenderContext, const FrameInfo&)>& cb)
 {
     d->draw_cb = cb;
     return *this;
 }
 
+RenderLoop& RenderLoop::onPrepare(const function<void(PlatformSurface*, FrameInfo&)>& cb)
+{
+    assert(!d->running && "onPrepare() MUST be called before start()");
+    d->prepare_cb = cb;
+    return *this;
+}
+
 RenderLoop& RenderLoop::onContextCreated(const function<void(PlatformSurface*,void*)>& cb)
 {
     d->ctx_created_cb = cb;
@@ -170,6 +1468,18 @@ RenderLoop& RenderLoop::onDestroyContext(const function<void(PlatformSurface*,vo
     return *this;
 }
 
+RenderLoop& RenderLoop::onSurfaceChanged(const function<void(PlatformSurface*,void*)>& cb)
+{
+    d->surface_changed_cb = cb;
+    return *this;
+}
+
+RenderLoop& RenderLoop::onDeadlineMissed(const function<void(PlatformSurface*, int64_t)>& cb)
+{
+    d->deadline_missed_cb = cb;
+    return *this;
+}
+
 RenderLoop& RenderLoop::onClose(const function<void(PlatformSurface*)>& cb)
 {
     d->close_cb = cb;
@@ -177,27 +1487,25 @@ RenderLoop& RenderLoop::onClose(const function<void(PlatformSurface*)>& cb)
 }
 
 weak_ptr<PlatformSurface> RenderLoop::add(PlatformSurface *surface)
+{
+    return add(surface, d->default_group);
+}
+
+weak_ptr<PlatformSurface> RenderLoop::add(PlatformSurface *surface, int contextGroup)
 {
     const shared_ptr<PlatformSurface> ss(surface);
-    auto sp = new SurfaceContext{ss, nullptr};
-    // TODO: lock?
-    const unique_lock lock(d->mtx);
-    d->surfaces.push_back(sp);
-    surface->setEventCallback([sp, this]{ // TODO: void(Event e)
-        d->schedule([sp, this]{
-            if (!process(sp)) {
-                clog << "surface removed by event callback..." << endl;
-            }
-        });
+    const auto p = d->pin(ss, contextGroup);
+    d->watch(surface);
+    surface->setEventCallback([wp = weak_ptr(p), this]{ // TODO: void(Event e)
+        if (const auto p = wp.lock())
+            d->post(this, p);
     });
-    d->schedule([sp, this]{
-        if (!process(sp)) { // create=>resize=>close event in 1 process()
-            clog << "deleting surface scheduled by surface add callback..." << endl;
-            const unique_lock lock(d->mtx);
-            auto it = find(d->surfaces.begin(), d->surfaces.end(), sp);
-            delete *it;
-            d->surfaces.erase(it); // gcc4.8 can not erase a const_iterator
-        }
+    const auto w = p->worker.load(memory_order_relaxed);
+    d->schedule(*w, [ss, p, w, this]{
+        SurfaceContext sc(ss);
+        sc.state = p;
+        sc.group = p->group;
+        d->adopt(this, *w, std::move(sc));
     });
     return ss;
 }
@@ -208,7 +1516,8 @@ PlatformSurface* RenderLoop::process(SurfaceContext *sp)
     void* ctx = sp->ctx;
     if (!surface->acquire())
         return surface;
-    activateRenderContext(surface, ctx);
+    if (!sp->detached && surface->nativeHandle()) // the handle may be already reset to null before its NativeHandle event is processed
+        d->activate(this, surface, ctx);
     PlatformSurface::Event e{};
     while (surface->popEvent(e)) {
         if (e.type == PlatformSurface::Event::Close) {
@@ -216,17 +1525,18 @@ PlatformSurface* RenderLoop::process(SurfaceContext *sp)
             if (ctx) {
                 if (d->ctx_destroy_cb)
                     d->ctx_destroy_cb(surface, ctx);
-                destroyRenderContext(surface, ctx);
+                if (sp->group >= 0 || !d->recycleContext(this, surface, ctx))
+                    destroyRenderContext(surface, ctx);
+                d->resetCurrent();
             }
+            sp->shared.reset(); // destroyed with the last surface of the group
             if (d->close_cb)
                 d->close_cb(surface);
             surface->release();
-            auto it = find(d->surfaces.begin(), d->surfaces.end(), sp);
-            const unique_lock lock(d->mtx);
             clog << "removing closed surface..." << endl;
-            d->surfaces.erase(it);
-            delete sp;
-            if (d->stop_on_last_close && d->surfaces.empty())
+            d->unwatch(surface);
+            d->erase(this, *sp);
+            if (d->stop_on_last_close && d->nb_surfaces == 0)
                 d->stop_requested = true;
             return nullptr; // FIXME
         } else if (e.type == PlatformSurface::Event::Resize) {
@@ -243,16 +1553,41 @@ PlatformSurface* RenderLoop::process(SurfaceContext *sp)
 #endif
         } else if (e.type == PlatformSurface::Event::NativeHandle) {
             std::clog << surface << "->PlatformSurface::Event::NativeHandle: " << e.handle.before << ">>>" << e.handle.after << std::endl;
-            if (e.handle.before && ctx) {
+            ++sp->handle_changes;
+            if (ctx && resetRenderContextSurface(surface, ctx)) { // only the drawable is changed, gpu resources are kept
+                d->resetCurrent();
+                sp->detached = !e.handle.after;
+                if (sp->detached)
+                    continue;
+                d->activate(this, surface, ctx);
+                if (d->surface_changed_cb)
+                    d->surface_changed_cb(surface, ctx);
+                continue;
+            }
+            sp->detached = false;
+            if (ctx) {
                 if (d->ctx_destroy_cb)
                     d->ctx_destroy_cb(surface, ctx);
                 destroyRenderContext(surface, ctx);
+                d->resetCurrent();
             }
             sp->ctx = nullptr;
+            sp->shared.reset();
             surface->release(); // assume createRenderContext() will not call any gl command, so surface->acquire() is not required.
             if (!e.handle.after)
                 return surface;
-            ctx = createRenderContext(surface);
+            ctx = sp->group < 0 ? d->reuseContext(this, surface) : nullptr;
+            if (!ctx && d->async_ctx && sp->group < 0) { // the remaining events are processed after context is created
+                d->createContextAsync(this, static_pointer_cast<Private::Pin>(sp->state), sp->handle_changes);
+                return surface;
+            }
+            if (!ctx) {
+                sp->shared = d->sharedContext(this, surface, sp->group);
+                if (sp->shared)
+                    ctx = createRenderContextShared(surface, sp->shared.get());
+                else
+                    ctx = createRenderContext(surface);
+            }
             if (!ctx) { // ss will be destroyed if not pushed to list
                 std::clog << "ERROR! Failed to create rendering context! platform surface handle: " << surface->nativeHandle() << std::endl;
                 return surface; // already release(). FIXME
@@ -260,29 +1595,29 @@ PlatformSurface* RenderLoop::process(SurfaceContext *sp)
             if (d->ctx_created_cb)
                 d->ctx_created_cb(surface, ctx);
             sp->ctx = ctx;
-            surface->setEventCallback([sp, this]{ // TODO: void(Event e)
-                d->schedule([sp, this]{
-                    if (!process(sp)) {
-                        clog << "surface removed by event callback..." << endl;
-                    }
-                });
-            });
             if (!surface->acquire())
                 return surface;
-            activateRenderContext(surface, ctx);
+            d->activate(this, surface, ctx);
         }
     }
-    if (!ctx) {
-        std::clog << "no gfx context. skip rendering..." << std::endl;
+    if (!ctx || sp->detached) {
+        std::clog << "no gfx context or native handle. skip rendering..." << std::endl;
         surface->release();
         return surface;
     }
-    if (d->draw_cb && d->draw_cb(surface, ctx)) { // not onDraw(surface) with surface is ok, because context is current
-        int changes = 0;
-        submitRenderContext(surface, ctx, &changes); // TODO: recreate context if false(device lost)?
-        surface->submit();
-        if (changes && sp->width > 0 && sp->height > 0) // surface->size() in thread may be not allowed
-            surface->PlatformSurface::resize(sp->width, sp->height);
+    sp->state->dirty.store(false, memory_order_release); // drawing the latest content now, pending update() for this surface is done
+    if (const auto& p = sp->pipeline) {
+        const lock_guard lock(p->mtx);
+        if (p->ready)
+            sp->frame = std::move(p->next);
+        p->ready = false;
+    }
+    const bool defer = exchange(sp->defer_submit, false);
+    if (d->draw_cb && d->draw_cb(surface, ctx, sp->frame)) { // not onDraw(surface) with surface is ok, because context is current
+        if (defer)
+            sp->submit_pending = true;
+        else
+            d->submit(this, *sp);
     }
     surface->release();
     return surface;
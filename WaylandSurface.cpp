@@ -12,6 +12,7 @@
 #include <cstring>
 #include <iostream>
 #include <linux/input-event-codes.h>
+#include <poll.h>
 
 _Pragma("weak wl_proxy_marshal_constructor_versioned") // wayland 1.10. inlined in wl_registry_bind(), ubuntu >= 17.10
 
@@ -108,17 +109,17 @@ WaylandSurface::~WaylandSurface()
 
 void WaylandSurface::processEvents()
 {
-    wl_display_dispatch_pending(display_);
-    wl_display_flush(display_);
-#if 0
+    // read from the connection if readable, otherwise eventFd() is always readable when polled
     while (wl_display_prepare_read(display_)) {
         wl_display_dispatch_pending(display_);
     }
     wl_display_flush(display_);
-    // poll(), wl_display_read_events(display);
-    wl_display_cancel_read(display_);
+    pollfd pfd{wl_display_get_fd(display_), POLLIN, 0};
+    if (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN))
+        wl_display_read_events(display_);
+    else
+        wl_display_cancel_read(display_);
     wl_display_dispatch_pending(display_);
-#endif
 }
 
 void WaylandSurface::registry_add_object(void *data, struct wl_registry *reg, uint32_t name, const char *interface, uint32_t version)
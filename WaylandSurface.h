@@ -23,6 +23,7 @@ public:
     ~WaylandSurface() override;
     void* nativeResource() const override { return display_;}
     void processEvents() override;
+    int eventFd() const override { return display_ ? wl_display_get_fd(display_) : -1;}
 
 protected:
     wl_display *display_ = nullptr;
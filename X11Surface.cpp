@@ -10,6 +10,8 @@
 #include "ugs/PlatformSurface.h"
 #include <cassert>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 
 #pragma weak XInitThreads
 _Pragma("weak XOpenDisplay")
@@ -18,6 +20,7 @@ _Pragma("weak XOpenDisplay")
 #pragma weak XCreateColormap
 #pragma weak XCreateWindow
 #pragma weak XDestroyWindow
+#pragma weak XEventsQueued
 #pragma weak XFlush
 #pragma weak XFree
 #pragma weak XGetWindowAttributes
@@ -70,8 +73,13 @@ public:
         if (!display_)
             return;
         const auto win = reinterpret_cast<Window>(nativeHandle());
-        if (win)
-            XDestroyWindow(display_, win);
+        if (!win)
+            return;
+        {
+            const std::lock_guard lock(windows_mtx);
+            windows.erase(win);
+        }
+        XDestroyWindow(display_, win);
     }
     void* nativeResource() const override {
         return ensure_x11_display();
@@ -95,7 +103,15 @@ public:
         PlatformSurface::resize(w, h);
     }
     void processEvents() override;
+    int eventFd() const override { return display_ ? ConnectionNumber(display_) : -1;}
+    bool eventsQueued() const override { return display_ && XEventsQueued(display_, QueuedAlready) > 0;}
 private:
+    void handleEvent(const XEvent& xev);
+
+    // all windows are on 1 display, events are read by any surface and dispatched to the surface of the event window
+    static inline std::mutex windows_mtx;
+    static inline std::unordered_map<Window, X11Surface*> windows;
+
     Display *display_ = nullptr;
     int w_ = 1920;
     int h_ = 1080;
@@ -138,28 +154,38 @@ X11Surface::X11Surface()
     XMapWindow(display_, win);
     XStoreName(display_, win, "X11Surface");
     //XSelectInput(display_, win, ExposureMask | KeyPressMask);
+    {
+        const std::lock_guard lock(windows_mtx);
+        windows[win] = this;
+    }
     resetNativeHandle(reinterpret_cast<void*>(win));
 }
 
 void X11Surface::processEvents() {
+    // drain all events of the display, otherwise the connection fd is not readable again while events are queued. events of windows without a surface are dropped
+    const std::lock_guard lock(windows_mtx);
     int n = XPending(display_);
     while (n--) {
         XEvent xev;
         XNextEvent(display_, &xev);
-        if (xev.type == ConfigureNotify) {
-            if (xev.xconfigure.window != reinterpret_cast<Window>(nativeHandle()))
-                return;
-            if (xev.xconfigure.width == w_ && xev.xconfigure.height == h_)
-                return;
-            w_ = xev.xconfigure.width;
-            h_ = xev.xconfigure.height;
-            PlatformSurface::resize(w_, h_);
-        } else if (xev.type == DestroyNotify) {
+        const auto it = windows.find(xev.xany.window);
+        if (it != windows.end())
+            it->second->handleEvent(xev);
+    }
+}
+
+void X11Surface::handleEvent(const XEvent& xev) {
+    if (xev.type == ConfigureNotify) {
+        if (xev.xconfigure.width == w_ && xev.xconfigure.height == h_)
+            return;
+        w_ = xev.xconfigure.width;
+        h_ = xev.xconfigure.height;
+        PlatformSurface::resize(w_, h_);
+    } else if (xev.type == DestroyNotify) {
 
-        } else if (xev.type == ClientMessage) {
-            if (xev.xclient.message_type == WM_PROTOCOLS && static_cast<Atom>(xev.xclient.data.l[0]) == WM_DELETE_WINDOW) {
-                PlatformSurface::close();
-            }
+    } else if (xev.type == ClientMessage) {
+        if (xev.xclient.message_type == WM_PROTOCOLS && static_cast<Atom>(xev.xclient.data.l[0]) == WM_DELETE_WINDOW) {
+            PlatformSurface::close();
         }
     }
 }
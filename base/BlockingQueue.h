@@ -17,6 +17,7 @@ template <typename T, template <typename...> class C = std::list> // TODO: use s
  * block pop      wake pop         wake push          block push
  * use min+1 as wake_pop_: size() <= min_ implies 1. min_ > 0 but not enough, 2. min_ == 0 && queue_.empty()
  * call setWaitForMin(false) to pop even if min is not reached.
+ * C can be ring_buffer(base/ring_buffer.h), which does not allocate per element like std::list and std::deque.
  */
 class BlockingQueue { // TODO: rename BlockingFIFO
 public:
@@ -64,8 +65,7 @@ public:
     size_t wakePush() const { return wake_push_;}
     void clear() {
         const std::lock_guard lock(mutex_);
-        queue_t tmp;
-        queue_.swap(tmp);
+        queue_.clear(); // keep capacity, e.g. ring_buffer
         full_.notify_all();
         size_ = 0;
         pop_waiting_ = true;
@@ -185,6 +185,43 @@ public:
         }
         return nb;
     }
+    /*!
+     * \brief popBatch
+     * Move at most max elements to out under 1 lock, e.g. drain pending tasks after a stall. Waits like pop(): blocks only if empty, and a blocked pop
+     * is woken by a push when size > min (or any push if setWaitForMin(false)). popWaiting() is updated the same way as pop()
+     * \param out output iterator, e.g. back_inserter(vec), or T*
+     * \return number of popped elements, 0 if max is 0
+     */
+    template<class OutputIt>
+    size_t popBatch(OutputIt out, size_t max) {
+        if (max == 0) // do not wait for nothing
+            return 0;
+        std::unique_lock lock(mutex_);
+        if (queue_.empty()) {
+            pop_waiting_ = true;
+            empty_.wait(lock, [this]{return !queue_.empty();});
+        }
+        return take(out, max);
+    }
+    // the same as popBatch(), but waits at most timeout ms if empty. return 0 if timed out
+    template<class OutputIt>
+    size_t tryPopBatch(OutputIt out, size_t max, int64_t timeout = 0) {
+        if (max == 0 || (size_ == 0 && timeout <= 0))
+            return 0;
+        std::unique_lock lock(mutex_);
+        if (queue_.empty()) {
+            pop_waiting_ = true;
+            if (timeout <= 0 || !empty_.wait_for(lock, std::chrono::milliseconds(timeout), [this]{return !queue_.empty();}))
+                return 0;
+        }
+        return take(out, max);
+    }
+    // move all elements to out. blocks if empty
+    template<class OutputIt>
+    size_t popAll(OutputIt out) {
+        return popBatch(out, std::numeric_limits<size_t>::max());
+    }
+
     size_t size() const { return size_;}
     size_t empty() const { return size() == 0;}
 
@@ -217,6 +254,24 @@ public:
     }
     // TODO: peak()/at()/[]?
 private:
+    // with lock held, queue is not empty
+    template<class OutputIt>
+    size_t take(OutputIt out, size_t max) {
+        const size_t nb = queue_.size();
+        const size_t n = std::min(nb, max);
+        pop_waiting_ = nb == n && min_ > 0; // drained, the same as the last pop() of nb == 1
+        for (size_t i = 0; i < n; ++i) {
+            *out++ = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        size_ -= n;
+        if (size_ <= wake_push_) {
+            push_waiting_ = false;
+            full_.notify_all(); // n slots are available
+        }
+        return n;
+    }
+
     bool wait_min_ = true;
     bool pop_waiting_ = true;
     bool push_waiting_ = false;
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * MIT License
+ * Move only callable wrapper with small buffer optimization
+ */
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template<typename Signature, size_t Capacity = 48>
+class Task;
+
+/*!
+ * \brief The Task class
+ * Like std::move_only_function, but callables no larger than Capacity bytes are guaranteed to be stored inline, i.e. no heap allocation.
+ * Larger callables, or callables which are not nothrow move constructible are allocated on heap.
+ */
+template<typename R, typename... Args, size_t Capacity>
+class Task<R(Args...), Capacity> {
+public:
+    Task() noexcept = default;
+    Task(std::nullptr_t) noexcept {}
+
+    template<typename F, typename D = std::decay_t<F>, typename = std::enable_if_t<!std::is_same_v<D, Task> && std::is_invocable_r_v<R, D&, Args...>>>
+    Task(F&& f) {
+        if constexpr (kInline<D>) {
+            ::new (static_cast<void*>(buf_)) D(std::forward<F>(f));
+        } else {
+            *reinterpret_cast<D**>(buf_) = new D(std::forward<F>(f));
+        }
+        vt_ = &kVTable<D>;
+    }
+
+    Task(Task&& other) noexcept {
+        take(other);
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    Task& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        reset();
+    }
+
+    explicit operator bool() const noexcept { return vt_;}
+
+    R operator()(Args... args) {
+        return vt_->invoke(buf_, std::forward<Args>(args)...);
+    }
+
+    template<typename F>
+    static constexpr bool isInline() { return kInline<std::decay_t<F>>;}
+private:
+    struct VTable {
+        R (*invoke)(void*, Args&&...);
+        void (*move)(void* dst, void* src) noexcept; // move construct dst and destroy src
+        void (*destroy)(void*) noexcept;
+    };
+
+    template<typename D>
+    static constexpr bool kInline = sizeof(D) <= Capacity && alignof(D) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<D>;
+
+    template<typename D>
+    static D* target(void* p) noexcept {
+        if constexpr (kInline<D>)
+            return std::launder(reinterpret_cast<D*>(p));
+        else
+            return *reinterpret_cast<D**>(p);
+    }
+
+    template<typename D>
+    static constexpr VTable kVTable = {
+        [](void* p, Args&&... args) -> R {
+            return (*target<D>(p))(std::forward<Args>(args)...);
+        },
+        [](void* dst, void* src) noexcept {
+            if constexpr (kInline<D>) {
+                D* s = target<D>(src);
+                ::new (dst) D(std::move(*s));
+                s->~D();
+            } else {
+                *reinterpret_cast<D**>(dst) = target<D>(src);
+            }
+        },
+        [](void* p) noexcept {
+            if constexpr (kInline<D>)
+                target<D>(p)->~D();
+            else
+                delete target<D>(p);
+        },
+    };
+
+    void take(Task& other) noexcept {
+        if (!other.vt_)
+            return;
+        other.vt_->move(buf_, other.buf_);
+        vt_ = other.vt_;
+        other.vt_ = nullptr;
+    }
+
+    void reset() noexcept {
+        if (!vt_)
+            return;
+        vt_->destroy(buf_);
+        vt_ = nullptr;
+    }
+
+    alignas(std::max_align_t) unsigned char buf_[Capacity < sizeof(void*) ? sizeof(void*) : Capacity];
+    const VTable* vt_ = nullptr;
+};
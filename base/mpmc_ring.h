@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * MIT License
+ * Bounded Lock Free MPMC ring buffer. Dmitry Vyukov's algorithm with per slot sequence numbers
+ * https://github.com/wang-bin/lockless
+ */
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include "parker.h"
+
+/*!
+ * \brief The mpmc_ring class
+ * Capacity is rounded up to a power of 2 and fixed, push fails if full. No allocation after construction.
+ * A slot is ready to push at position pos if its sequence is pos, and ready to pop if sequence is pos + 1.
+ * T MUST be default constructible and move assignable.
+ */
+template<typename T>
+class mpmc_ring {
+public:
+    explicit mpmc_ring(size_t capacity)
+        : mask_(std::bit_ceil(capacity < 2 ? 2 : capacity) - 1)
+        , slots_(new slot[mask_ + 1])
+    {
+        for (size_t i = 0; i <= mask_; ++i)
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    mpmc_ring(const mpmc_ring&) = delete;
+    mpmc_ring& operator=(const mpmc_ring&) = delete;
+
+    size_t capacity() const { return mask_ + 1;}
+    // approximate if other threads are pushing or popping
+    size_t size() const {
+        const size_t t = tail_.load(std::memory_order_relaxed);
+        const size_t h = head_.load(std::memory_order_relaxed);
+        return h > t ? h - t : 0;
+    }
+    bool empty() const { return size() == 0;}
+
+    template<typename... Args>
+    bool try_emplace(Args&&... args) {
+        size_t pos = 0;
+        slot* s = claim_push(pos);
+        if (!s)
+            return false;
+        s->v = T(std::forward<Args>(args)...);
+        s->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_push(T&& v) {
+        return try_emplace(std::move(v));
+    }
+
+    bool try_pop(T* v = nullptr) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        slot* s = nullptr;
+        while (true) {
+            s = &slots_[pos & mask_];
+            const auto d = intptr_t(s->seq.load(std::memory_order_acquire)) - intptr_t(pos + 1);
+            if (d == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (d < 0) { // empty
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        take(s, pos, v);
+        return true;
+    }
+
+    // push elements in [v, v + n) until full. return number of pushed elements. consecutive positions are claimed by 1 CAS, so elements from 1 batch are not interleaved with other producers
+    size_t try_push_batch(T* v, size_t n) {
+        if (n == 0) // ready() is 0 and never full
+            return 0;
+        size_t pos = head_.load(std::memory_order_relaxed);
+        size_t k = 0;
+        while (true) {
+            k = ready(pos, n, 0);
+            if (k == 0) {
+                if (intptr_t(slots_[pos & mask_].seq.load(std::memory_order_acquire)) - intptr_t(pos) < 0) // full
+                    return 0;
+                pos = head_.load(std::memory_order_relaxed);
+                continue;
+            }
+            // a ready slot stays ready until its position is claimed, so all k slots are owned after CAS
+            if (head_.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed))
+                break;
+        }
+        for (size_t i = 0; i < k; ++i) {
+            slot& s = slots_[(pos + i) & mask_];
+            s.v = std::move(v[i]);
+            s.seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return k;
+    }
+
+    // pop at most n elements to out. return number of popped elements
+    size_t try_pop_batch(T* out, size_t n) {
+        if (n == 0) // ready() is 0 and never empty
+            return 0;
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        size_t k = 0;
+        while (true) {
+            k = ready(pos, n, 1);
+            if (k == 0) {
+                if (intptr_t(slots_[pos & mask_].seq.load(std::memory_order_acquire)) - intptr_t(pos + 1) < 0) // empty
+                    return 0;
+                pos = tail_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (tail_.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed))
+                break;
+        }
+        for (size_t i = 0; i < k; ++i)
+            take(&slots_[(pos + i) & mask_], pos + i, out ? &out[i] : nullptr);
+        return k;
+    }
+private:
+    struct slot {
+        std::atomic<size_t> seq;
+        T v;
+    };
+
+    slot* claim_push(size_t& pos) {
+        pos = head_.load(std::memory_order_relaxed);
+        while (true) {
+            slot* s = &slots_[pos & mask_];
+            const auto d = intptr_t(s->seq.load(std::memory_order_acquire)) - intptr_t(pos);
+            if (d == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    return s;
+            } else if (d < 0) { // full
+                return nullptr;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // number of consecutive slots from pos, at most n, whose seq is pos + i + off
+    size_t ready(size_t pos, size_t n, size_t off) const {
+        size_t k = 0;
+        while (k < n && k <= mask_ && slots_[(pos + k) & mask_].seq.load(std::memory_order_acquire) == pos + k + off)
+            ++k;
+        return k;
+    }
+
+    void take(slot* s, size_t pos, T* v) {
+        if (v)
+            *v = std::move(s->v);
+        else
+            s->v = T();
+        s->seq.store(pos + mask_ + 1, std::memory_order_release);
+    }
+
+    const size_t mask_;
+    const std::unique_ptr<slot[]> slots_;
+    // producers and consumers are on different cache lines
+    alignas(64) std::atomic<size_t> head_ = 0; // next push position
+    alignas(64) std::atomic<size_t> tail_ = 0; // next pop position, sizeof(mpmc_ring) is padded to 64 too
+};
+
+/*!
+ * \brief The blocking_ring class
+ * mpmc_ring whose push blocks if full and pop blocks if empty. Waiters yield a few times then sleep on a futex(event_count), push/pop without waiters do not enter kernel.
+ */
+template<typename T>
+class blocking_ring {
+public:
+    explicit blocking_ring(size_t capacity) : ring_(capacity) {}
+
+    size_t capacity() const { return ring_.capacity();}
+    size_t size() const { return ring_.size();}
+    bool empty() const { return ring_.empty();}
+
+    bool try_push(T&& v) {
+        if (!ring_.try_push(std::move(v)))
+            return false;
+        not_empty_.notify_all();
+        return true;
+    }
+
+    bool try_pop(T* v = nullptr) {
+        if (!ring_.try_pop(v))
+            return false;
+        not_full_.notify_all();
+        return true;
+    }
+
+    void push(T&& v) {
+        while (!spin([&]{ return ring_.try_push(std::move(v));})) { // v is not moved if failed
+            const auto key = not_full_.prepare_wait();
+            if (ring_.try_push(std::move(v))) {
+                not_full_.cancel_wait();
+                break;
+            }
+            not_full_.wait(key);
+        }
+        not_empty_.notify_all();
+    }
+
+    void pop(T* v = nullptr) {
+        while (!spin([&]{ return ring_.try_pop(v);})) {
+            const auto key = not_empty_.prepare_wait();
+            if (ring_.try_pop(v)) {
+                not_empty_.cancel_wait();
+                break;
+            }
+            not_empty_.wait(key);
+        }
+        not_full_.notify_all();
+    }
+
+    // push all n elements, blocks if full
+    void push_batch(T* v, size_t n) {
+        while (n > 0) {
+            size_t k = 0;
+            if (!spin([&]{ return (k = ring_.try_push_batch(v, n)) > 0;})) {
+                const auto key = not_full_.prepare_wait();
+                k = ring_.try_push_batch(v, n);
+                if (k == 0) {
+                    not_full_.wait(key);
+                    continue;
+                }
+                not_full_.cancel_wait();
+            }
+            v += k;
+            n -= k;
+            not_empty_.notify_all();
+        }
+    }
+
+    // pop at least 1 and at most n elements. blocks if empty. return number of popped elements, 0 if n is 0
+    size_t pop_batch(T* out, size_t n) {
+        if (n == 0)
+            return 0;
+        size_t k = 0;
+        while (!spin([&]{ return (k = ring_.try_pop_batch(out, n)) > 0;})) {
+            const auto key = not_empty_.prepare_wait();
+            if ((k = ring_.try_pop_batch(out, n)) > 0) {
+                not_empty_.cancel_wait();
+                break;
+            }
+            not_empty_.wait(key);
+        }
+        not_full_.notify_all();
+        return k;
+    }
+private:
+    // the other side is likely to make progress in a time slice, which is much cheaper than futex wait + wake
+    template<typename F>
+    static bool spin(F&& f) {
+        for (int i = 0; i < 16; ++i) {
+            if (f())
+                return true;
+            std::this_thread::yield();
+        }
+        return false;
+    }
+
+    mpmc_ring<T> ring_;
+    event_count not_empty_;
+    event_count not_full_;
+};
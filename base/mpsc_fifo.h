@@ -1,23 +1,40 @@
 /*
- * Copyright (c) 2017-2018 WangBin <wbsecg1 at gmail.com>
+ * Copyright (c) 2017-2025 WangBin <wbsecg1 at gmail.com>
  * MIT License
  * Lock Free MPSC FIFO
  * https://github.com/wang-bin/lockless
  */
 #pragma once
 #include <atomic>
+#include <bit>
+#include <cstdint>
+#include <mutex>
 #include <utility>
 
 #define MPSC_FIFO_RAW_NEXT_PTR 0
 
-template<typename T>
+/*!
+ * \brief The mpsc_fifo class
+ * Recycle: popped nodes are pushed to a lock free free list and reused by producers, so no allocation in steady state. Nodes are allocated in chunks
+ * which are released in dtor, i.e. memory is not returned after a burst. Otherwise(default) new/delete for each element.
+ * T MUST be default constructible and move assignable if Recycle is true.
+ */
+template<typename T, bool Recycle = false>
 class mpsc_fifo {
 public:
-    mpsc_fifo() { in_.store(out_); }
+    mpsc_fifo() {
+        out_ = alloc();
+        in_.store(out_);
+    }
 
     ~mpsc_fifo() {
         clear();
-        delete out_;
+        if constexpr (Recycle) {
+            for (auto& c : chunks_)
+                delete[] c.load(std::memory_order_relaxed);
+        } else {
+            delete out_;
+        }
     }
 
     // return number of element cleared
@@ -30,45 +47,48 @@ public:
 
     template<typename... Args>
     void emplace(Args&&... args) {
-        node *n = new node{std::forward<Args>(args)...};
-#if MPSC_FIFO_RAW_NEXT_PTR // slower
-        node* t = in_.load(std::memory_order_relaxed);
-        do {
-            t->next = n;
-        } while (!in_.compare_exchange_weak(t, n, std::memory_order_acq_rel, std::memory_order_relaxed));
-#else
-        node* t = in_.exchange(n, std::memory_order_acq_rel);
-        t->next.store(n, std::memory_order_release);
-#endif
+        if constexpr (Recycle) {
+            node *n = alloc();
+            n->v = T(std::forward<Args>(args)...);
+            link(n);
+        } else {
+            link(new node{std::forward<Args>(args)...});
+        }
     }
 
     void push(T&& v) {
-        node *n = new node{std::move(v)};
-#if MPSC_FIFO_RAW_NEXT_PTR // slower
-        node* t = in_.load(std::memory_order_relaxed);
-        do {
-            t->next = n;
-        } while (!in_.compare_exchange_weak(t, n, std::memory_order_acq_rel, std::memory_order_relaxed));
-#else
-        node* t = in_.exchange(n, std::memory_order_acq_rel);
-        t->next.store(n, std::memory_order_release);
-#endif
+        if constexpr (Recycle) {
+            node *n = alloc();
+            n->v = std::move(v);
+            link(n);
+        } else {
+            link(new node{std::move(v)});
+        }
+    }
+
+    // the next element to pop, or null if empty. in consumer thread
+    T* front() {
+        if (out_ == in_.load(std::memory_order_relaxed))
+            return nullptr;
+        node *n = next(out_);
+        return n ? &n->v : nullptr;
     }
 
     bool pop(T* v = nullptr) {
         // will check next.load() later, also next.store() in push() must be after exchange, so relaxed is enough
         if (out_ == in_.load(std::memory_order_relaxed)) //if (!out_->next) // not completely write to out_->next (t->next.store()), next is not null but invalid
             return false;
-#if MPSC_FIFO_RAW_NEXT_PTR
-        node *n = out_->next;
-#else
-        node *n = out_->next.load(std::memory_order_relaxed);
-#endif
+        node *n = next(out_);
         if (!n) // before t->next.store() after in_.exchange() in push()
             return false;
         if (v)
             *v = std::move(n->v);
-        delete out_;
+        else if constexpr (Recycle) // n is the new head and will be recycled later, do not keep the value alive
+            n->v = T();
+        if constexpr (Recycle)
+            recycle(out_);
+        else
+            delete out_;
         out_ = n;
         return true;
     }
@@ -81,7 +101,112 @@ private:
         std::atomic<node*> next;
 #endif
     };
+    struct pooled_node : node {
+        std::atomic<uint32_t> free_next; // index + 1 of the next free node, 0 is end
+        uint32_t index;
+    };
+
+    static node* next(node* n) {
+#if MPSC_FIFO_RAW_NEXT_PTR
+        return n->next;
+#else
+        return n->next.load(std::memory_order_acquire);
+#endif
+    }
+
+    static void reset_next(node* n) {
+#if MPSC_FIFO_RAW_NEXT_PTR
+        n->next = nullptr;
+#else
+        n->next.store(nullptr, std::memory_order_relaxed);
+#endif
+    }
+
+    void link(node* n) {
+#if MPSC_FIFO_RAW_NEXT_PTR // slower
+        node* t = in_.load(std::memory_order_relaxed);
+        do {
+            t->next = n;
+        } while (!in_.compare_exchange_weak(t, n, std::memory_order_acq_rel, std::memory_order_relaxed));
+#else
+        node* t = in_.exchange(n, std::memory_order_acq_rel);
+        t->next.store(n, std::memory_order_release);
+#endif
+    }
+
+    node* alloc() {
+        if constexpr (Recycle) {
+            if (node* n = try_alloc())
+                return n;
+            return grow();
+        } else {
+            return new node();
+        }
+    }
+
+    // free nodes are stored in chunks which are never released until dtor, so reading free_next of a node popped by another producer is safe.
+    // head is (tag << 32 | index + 1), tag is increased by every change to avoid ABA
+    static constexpr uint32_t kChunk0 = 64; // chunk k has kChunk0 << k nodes
+    static constexpr int kMaxChunks = 32;
+
+    pooled_node* at(uint32_t index) const {
+        const uint32_t k = std::bit_width(index / kChunk0 + 1) - 1;
+        const uint32_t base = kChunk0 * ((1u << k) - 1);
+        return &chunks_[k].load(std::memory_order_acquire)[index - base];
+    }
+
+    node* try_alloc() {
+        uint64_t h = free_.load(std::memory_order_acquire);
+        while (uint32_t(h)) {
+            pooled_node* n = at(uint32_t(h) - 1);
+            const uint64_t nh = ((h >> 32) + 1) << 32 | n->free_next.load(std::memory_order_relaxed);
+            if (free_.compare_exchange_weak(h, nh, std::memory_order_acquire, std::memory_order_acquire)) {
+                reset_next(n);
+                return n;
+            }
+        }
+        return nullptr;
+    }
+
+    node* grow() {
+        const std::lock_guard lock(grow_mtx_);
+        if (node* n = try_alloc()) // recycled by consumer or grown by another producer
+            return n;
+        const int k = nb_chunks_++;
+        const uint32_t size = kChunk0 << k;
+        const uint32_t base = kChunk0 * ((1u << k) - 1);
+        pooled_node* c = new pooled_node[size];
+        for (uint32_t i = 0; i < size; ++i) {
+            c[i].index = base + i;
+            reset_next(&c[i]);
+            c[i].free_next.store(base + i + 2, std::memory_order_relaxed); // i + 1 is the next
+        }
+        chunks_[k].store(c, std::memory_order_release);
+        if (size > 1)
+            release(&c[1], &c[size - 1]);
+        return &c[0];
+    }
+
+    void recycle(node* n) {
+        auto p = static_cast<pooled_node*>(n);
+        release(p, p);
+    }
+
+    // push a linked chain [first, last] of free nodes
+    void release(pooled_node* first, pooled_node* last) {
+        uint64_t h = free_.load(std::memory_order_relaxed);
+        uint64_t nh = 0;
+        do {
+            last->free_next.store(uint32_t(h), std::memory_order_relaxed);
+            nh = ((h >> 32) + 1) << 32 | (first->index + 1);
+        } while (!free_.compare_exchange_weak(h, nh, std::memory_order_release, std::memory_order_relaxed));
+    }
 
-    node *out_ = new node();
+    node *out_ = nullptr;
     std::atomic<node*> in_; // can not use in_{out_} because atomic ctor with desired value MUST be constexpr (error in g++4.8 iff use template)
+    // Recycle only
+    std::atomic<uint64_t> free_ = 0;
+    std::atomic<pooled_node*> chunks_[kMaxChunks] = {};
+    int nb_chunks_ = 0;
+    std::mutex grow_mtx_;
 };
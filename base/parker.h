@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * MIT License
+ * Park/unpark a single waiter thread, and event_count for any number of waiters. futex on linux, condition_variable otherwise
+ * https://github.com/wang-bin/lockless
+ */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#if defined(__linux__)
+# include <climits>
+# include <ctime>
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#else
+# include <condition_variable>
+# include <mutex>
+#endif
+
+// permit semantics: unpark() before park() makes the next park() return immediately. spurious wakeup is possible, waiter MUST recheck the condition
+class parker {
+public:
+    void park() {
+#if defined(__linux__)
+        while (permit_.exchange(0, std::memory_order_acquire) == 0)
+            futex_wait(nullptr);
+#else
+        std::unique_lock lock(mtx_);
+        cv_.wait(lock, [this]{ return permit_.load(std::memory_order_relaxed) != 0;});
+        permit_.store(0, std::memory_order_relaxed);
+#endif
+    }
+
+    // return false if timed out
+    template<class Rep, class Period>
+    bool park_for(const std::chrono::duration<Rep, Period>& timeout) {
+        using namespace std::chrono;
+        if (timeout <= timeout.zero())
+            return permit_.exchange(0, std::memory_order_acquire) != 0;
+        const auto deadline = steady_clock::now() + ceil<steady_clock::duration>(timeout);
+#if defined(__linux__)
+        while (permit_.exchange(0, std::memory_order_acquire) == 0) {
+            const auto left = deadline - steady_clock::now();
+            if (left <= left.zero())
+                return false;
+            const auto s = duration_cast<seconds>(left);
+            const timespec ts{time_t(s.count()), long(duration_cast<nanoseconds>(left - s).count())};
+            futex_wait(&ts);
+        }
+        return true;
+#else
+        std::unique_lock lock(mtx_);
+        if (!cv_.wait_until(lock, deadline, [this]{ return permit_.load(std::memory_order_relaxed) != 0;}))
+            return false;
+        permit_.store(0, std::memory_order_relaxed);
+        return true;
+#endif
+    }
+
+    void unpark() {
+#if defined(__linux__)
+        if (permit_.exchange(1, std::memory_order_release) == 0)
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&permit_), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+        {
+            const std::lock_guard lock(mtx_);
+            permit_.store(1, std::memory_order_relaxed);
+        }
+        cv_.notify_one();
+#endif
+    }
+private:
+#if defined(__linux__)
+    void futex_wait(const timespec* timeout) {
+        // returns immediately if permit_ is no longer 0(EAGAIN)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&permit_), FUTEX_WAIT_PRIVATE, 0, timeout, nullptr, 0);
+    }
+#else
+    std::mutex mtx_;
+    std::condition_variable cv_;
+#endif
+    std::atomic<uint32_t> permit_ = 0;
+};
+
+/*!
+ * \brief The event_count class
+ * Blocks any number of waiters until notified. A waiter MUST call prepare_wait(), recheck the condition, then wait(key) or cancel_wait():
+ *   if (cond()) return; auto key = ec.prepare_wait(); if (cond()) { ec.cancel_wait(); return; } ec.wait(key);
+ * A notifier changes the condition then calls notify_all(), which is only a fence and a load if nobody is waiting.
+ */
+class event_count {
+public:
+    uint32_t prepare_wait() {
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        return epoch_.load(std::memory_order_acquire);
+    }
+
+    void cancel_wait() {
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void wait(uint32_t key) {
+#if defined(__linux__)
+        while (epoch_.load(std::memory_order_acquire) == key)
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAIT_PRIVATE, key, nullptr, nullptr, 0);
+#else
+        std::unique_lock lock(mtx_);
+        cv_.wait(lock, [=, this]{ return epoch_.load(std::memory_order_relaxed) != key;});
+#endif
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void notify_all() {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // the condition change is visible to a waiter, or the waiter is visible here
+        if (waiters_.load(std::memory_order_relaxed) == 0)
+            return;
+#if defined(__linux__)
+        epoch_.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+        {
+            const std::lock_guard lock(mtx_);
+            epoch_.fetch_add(1, std::memory_order_relaxed);
+        }
+        cv_.notify_all();
+#endif
+    }
+private:
+#if !defined(__linux__)
+    std::mutex mtx_;
+    std::condition_variable cv_;
+#endif
+    std::atomic<uint32_t> epoch_ = 0;
+    std::atomic<uint32_t> waiters_ = 0;
+};
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * MIT License
+ * Contiguous growable ring buffer, a sequence container for FIFOs
+ */
+#pragma once
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+/*!
+ * \brief The ring_buffer class
+ * push_back/emplace_back/pop_front/front/back like std::deque, elements are stored in 1 contiguous array.
+ * Capacity is a power of 2 and grows geometrically if full, it's never released by pop_front() and clear(), so no allocation in steady state.
+ * Can be used as the container of BlockingQueue, e.g. BlockingQueue<T, ring_buffer>
+ */
+template<typename T, typename Alloc = std::allocator<T>>
+class ring_buffer {
+    using traits = std::allocator_traits<Alloc>;
+public:
+    using value_type = T;
+    using allocator_type = Alloc;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using reference = T&;
+    using const_reference = const T&;
+
+    template<bool Const>
+    class iterator_t {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = ptrdiff_t;
+        using pointer = std::conditional_t<Const, const T*, T*>;
+        using reference = std::conditional_t<Const, const T&, T&>;
+
+        iterator_t() = default;
+        iterator_t(std::conditional_t<Const, const ring_buffer*, ring_buffer*> rb, size_t i) : rb_(rb), i_(i) {}
+        operator iterator_t<true>() const { return {rb_, i_};}
+
+        reference operator*() const { return (*rb_)[i_];}
+        pointer operator->() const { return &(*rb_)[i_];}
+        reference operator[](difference_type n) const { return (*rb_)[i_ + n];}
+        iterator_t& operator++() { ++i_; return *this;}
+        iterator_t operator++(int) { auto t = *this; ++i_; return t;}
+        iterator_t& operator--() { --i_; return *this;}
+        iterator_t operator--(int) { auto t = *this; --i_; return t;}
+        iterator_t& operator+=(difference_type n) { i_ += n; return *this;}
+        iterator_t& operator-=(difference_type n) { i_ -= n; return *this;}
+        iterator_t operator+(difference_type n) const { return {rb_, i_ + n};}
+        friend iterator_t operator+(difference_type n, const iterator_t& it) { return it + n;}
+        iterator_t operator-(difference_type n) const { return {rb_, i_ - n};}
+        difference_type operator-(const iterator_t& other) const { return difference_type(i_ - other.i_);}
+        bool operator==(const iterator_t& other) const { return i_ == other.i_;}
+        auto operator<=>(const iterator_t& other) const { return i_ <=> other.i_;}
+    private:
+        std::conditional_t<Const, const ring_buffer*, ring_buffer*> rb_ = nullptr;
+        size_t i_ = 0; // index from front
+    };
+    using iterator = iterator_t<false>;
+    using const_iterator = iterator_t<true>;
+
+    ring_buffer() = default;
+    explicit ring_buffer(const Alloc& a) : alloc_(a) {}
+
+    ring_buffer(const ring_buffer& other)
+        : alloc_(traits::select_on_container_copy_construction(other.alloc_))
+    {
+        reserve(other.size_);
+        for (const auto& v : other)
+            emplace_back(v);
+    }
+
+    ring_buffer(ring_buffer&& other) noexcept
+        : alloc_(std::move(other.alloc_))
+        , data_(std::exchange(other.data_, nullptr))
+        , cap_(std::exchange(other.cap_, 0))
+        , head_(std::exchange(other.head_, 0))
+        , size_(std::exchange(other.size_, 0))
+    {}
+
+    ring_buffer& operator=(ring_buffer other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~ring_buffer() {
+        clear();
+        if (data_)
+            traits::deallocate(alloc_, data_, cap_);
+    }
+
+    void swap(ring_buffer& other) noexcept {
+        using std::swap;
+        if constexpr (traits::propagate_on_container_swap::value)
+            swap(alloc_, other.alloc_);
+        swap(data_, other.data_);
+        swap(cap_, other.cap_);
+        swap(head_, other.head_);
+        swap(size_, other.size_);
+    }
+
+    size_t size() const { return size_;}
+    bool empty() const { return size_ == 0;}
+    size_t capacity() const { return cap_;}
+    allocator_type get_allocator() const { return alloc_;}
+
+    T& operator[](size_t i) { return data_[(head_ + i) & (cap_ - 1)];}
+    const T& operator[](size_t i) const { return data_[(head_ + i) & (cap_ - 1)];}
+    T& front() { return data_[head_];}
+    const T& front() const { return data_[head_];}
+    T& back() { return (*this)[size_ - 1];}
+    const T& back() const { return (*this)[size_ - 1];}
+
+    iterator begin() { return {this, 0};}
+    iterator end() { return {this, size_};}
+    const_iterator begin() const { return {this, 0};}
+    const_iterator end() const { return {this, size_};}
+    const_iterator cbegin() const { return begin();}
+    const_iterator cend() const { return end();}
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (size_ == cap_)
+            reserve(cap_ ? cap_ * 2 : 16);
+        T* p = &data_[(head_ + size_) & (cap_ - 1)];
+        traits::construct(alloc_, p, std::forward<Args>(args)...);
+        ++size_;
+        return *p;
+    }
+
+    void push_back(const T& v) { emplace_back(v);}
+    void push_back(T&& v) { emplace_back(std::move(v));}
+
+    void pop_front() {
+        traits::destroy(alloc_, &data_[head_]);
+        head_ = (head_ + 1) & (cap_ - 1);
+        --size_;
+    }
+
+    // capacity is kept
+    void clear() {
+        while (size_ > 0)
+            pop_front();
+        head_ = 0;
+    }
+
+    // capacity will be a power of 2 >= n. elements are moved to the beginning of the new storage
+    void reserve(size_t n) {
+        if (n <= cap_)
+            return;
+        const size_t cap = std::bit_ceil(n);
+        T* data = traits::allocate(alloc_, cap);
+        for (size_t i = 0; i < size_; ++i) {
+            T& v = (*this)[i];
+            traits::construct(alloc_, &data[i], std::move_if_noexcept(v));
+            traits::destroy(alloc_, &v);
+        }
+        if (data_)
+            traits::deallocate(alloc_, data_, cap_);
+        data_ = data;
+        cap_ = cap;
+        head_ = 0;
+    }
+private:
+    [[no_unique_address]] Alloc alloc_;
+    T* data_ = nullptr;
+    size_t cap_ = 0; // 0 or power of 2
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+template<typename T, typename Alloc>
+void swap(ring_buffer<T, Alloc>& a, ring_buffer<T, Alloc>& b) noexcept
+{
+    a.swap(b);
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * MIT License
+ * Dense slot map with generation checked handles
+ */
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+/*!
+ * \brief The slot_map class
+ * Values are stored contiguously, insert and erase are O(1). Erasing moves the last value into the hole, so iteration order is not stable.
+ * A handle stays valid until its value is erased, then get() returns null even if the slot is reused by a new value.
+ * Not thread safe.
+ */
+template<typename T>
+class slot_map {
+public:
+    using handle = uint64_t; // generation << 32 | slot index. 0 is never a valid handle
+
+    template<typename... Args>
+    handle emplace(Args&&... args) {
+        uint32_t i = free_;
+        if (i == kNone) {
+            i = uint32_t(slots_.size());
+            slots_.push_back({});
+        } else {
+            free_ = slots_[i].pos;
+        }
+        auto& s = slots_[i];
+        s.pos = uint32_t(values_.size());
+        values_.emplace_back(std::forward<Args>(args)...);
+        owners_.push_back(i);
+        return handle(s.gen) << 32 | i;
+    }
+
+    // if removed is not null, the erased value is moved to it. return false if handle is stale
+    bool erase(handle h, T* removed = nullptr) {
+        Slot* s = slot(h);
+        if (!s)
+            return false;
+        const auto pos = s->pos;
+        if (removed)
+            *removed = std::move(values_[pos]);
+        if (pos + 1 != values_.size()) {
+            values_[pos] = std::move(values_.back());
+            owners_[pos] = owners_.back();
+            slots_[owners_[pos]].pos = pos;
+        }
+        values_.pop_back();
+        owners_.pop_back();
+        if (++s->gen == 0) // 0 is reserved for invalid handle
+            s->gen = 1;
+        s->pos = free_;
+        free_ = uint32_t(s - slots_.data());
+        return true;
+    }
+
+    T* get(handle h) {
+        const Slot* s = slot(h);
+        return s ? &values_[s->pos] : nullptr;
+    }
+
+    // handle of values()[pos]
+    handle handle_at(size_t pos) const {
+        const auto i = owners_[pos];
+        return handle(slots_[i].gen) << 32 | i;
+    }
+
+    size_t size() const { return values_.size();}
+    bool empty() const { return values_.empty();}
+    T& operator[](size_t pos) { return values_[pos];}
+    auto begin() { return values_.begin();}
+    auto end() { return values_.end();}
+    auto begin() const { return values_.begin();}
+    auto end() const { return values_.end();}
+
+    // stable sort values. handles are still valid
+    template<typename Compare>
+    void sort(Compare comp) {
+        std::vector<uint32_t> order(values_.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return comp(values_[a], values_[b]);});
+        std::vector<T> values;
+        std::vector<uint32_t> owners;
+        values.reserve(order.size());
+        owners.reserve(order.size());
+        for (const auto pos : order) {
+            slots_[owners_[pos]].pos = uint32_t(values.size());
+            values.push_back(std::move(values_[pos]));
+            owners.push_back(owners_[pos]);
+        }
+        values_.swap(values);
+        owners_.swap(owners);
+    }
+
+    void clear() {
+        for (size_t pos = values_.size(); pos > 0; --pos)
+            erase(handle_at(pos - 1));
+    }
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+    struct Slot {
+        uint32_t gen = 1;
+        uint32_t pos = 0; // index of value if alive, otherwise next free slot
+    };
+
+    Slot* slot(handle h) {
+        const auto i = uint32_t(h);
+        if (i >= slots_.size())
+            return nullptr;
+        auto& s = slots_[i];
+        if (s.gen != uint32_t(h >> 32))
+            return nullptr;
+        return &s;
+    }
+
+    std::vector<T> values_;
+    std::vector<uint32_t> owners_; // slot index of each value
+    std::vector<Slot> slots_;
+    uint32_t free_ = kNone;
+};
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * MIT License
+ * Wait Free SPSC ring buffer, and an unbounded SPSC FIFO of rings
+ * https://github.com/wang-bin/lockless
+ */
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/*!
+ * \brief The spsc_ring class
+ * Capacity is rounded up to a power of 2 and fixed, push fails if full. No atomic RMW, the producer only stores head and the consumer only stores tail.
+ * Each side caches the index of the other side and reloads it only if the ring looks full/empty, so the cache line of the other side is rarely touched.
+ * T MUST be default constructible and move assignable.
+ */
+template<typename T>
+class spsc_ring {
+public:
+    explicit spsc_ring(size_t capacity)
+        : mask_(std::bit_ceil(capacity < 2 ? 2 : capacity) - 1)
+        , slots_(new T[mask_ + 1])
+    {}
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    size_t capacity() const { return mask_ + 1;}
+    // approximate if called in neither producer nor consumer thread
+    size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);}
+    bool empty() const { return size() == 0;}
+
+    // in producer thread. args are not used if full
+    template<typename... Args>
+    bool try_emplace(Args&&... args) {
+        const size_t h = head_.load(std::memory_order_relaxed);
+        if (h - tail_cached_ > mask_) {
+            tail_cached_ = tail_.load(std::memory_order_acquire);
+            if (h - tail_cached_ > mask_)
+                return false;
+        }
+        slots_[h & mask_] = T(std::forward<Args>(args)...);
+        head_.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_push(T&& v) {
+        return try_emplace(std::move(v));
+    }
+
+    // the next element to pop, or null if empty. in consumer thread
+    T* front() {
+        const size_t t = tail_.load(std::memory_order_relaxed);
+        if (t == head_cached_) {
+            head_cached_ = head_.load(std::memory_order_acquire);
+            if (t == head_cached_)
+                return nullptr;
+        }
+        return &slots_[t & mask_];
+    }
+
+    // in consumer thread
+    bool try_pop(T* v = nullptr) {
+        T* p = front();
+        if (!p)
+            return false;
+        if (v)
+            *v = std::move(*p);
+        else
+            *p = T();
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return true;
+    }
+private:
+    const size_t mask_;
+    const std::unique_ptr<T[]> slots_;
+    alignas(64) std::atomic<size_t> head_ = 0; // next push position
+    size_t tail_cached_ = 0; // producer's copy of tail_
+    alignas(64) std::atomic<size_t> tail_ = 0; // next pop position
+    size_t head_cached_ = 0; // consumer's copy of head_
+};
+
+/*!
+ * \brief The spsc_fifo class
+ * Unbounded SPSC FIFO. A linked list of spsc_ring. If the last ring is full, producer links a new ring of double capacity, and consumer deletes a ring after it's drained,
+ * so no allocation in steady state. Push is wait free except growing.
+ */
+template<typename T>
+class spsc_fifo {
+public:
+    explicit spsc_fifo(size_t capacity = 64)
+        : out_(new segment(capacity))
+        , in_(out_)
+    {}
+    spsc_fifo(const spsc_fifo&) = delete;
+    spsc_fifo& operator=(const spsc_fifo&) = delete;
+
+    ~spsc_fifo() {
+        while (out_)
+            delete std::exchange(out_, out_->next.load(std::memory_order_relaxed));
+    }
+
+    // in producer thread
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        if (in_->ring.try_emplace(std::forward<Args>(args)...))
+            return;
+        auto s = new segment(in_->ring.capacity() * 2);
+        s->ring.try_emplace(std::forward<Args>(args)...);
+        in_->next.store(s, std::memory_order_release);
+        in_ = s;
+    }
+
+    void push(T&& v) {
+        emplace(std::move(v));
+    }
+
+    // the next element to pop, or null if empty. in consumer thread
+    T* front() {
+        if (T* v = out_->ring.front())
+            return v;
+        segment* n = out_->next.load(std::memory_order_acquire);
+        if (!n)
+            return nullptr;
+        // producer never pushes to out_ after linking next, and all elements pushed before are visible now
+        if (T* v = out_->ring.front())
+            return v;
+        delete std::exchange(out_, n);
+        return out_->ring.front();
+    }
+
+    // in consumer thread
+    bool pop(T* v = nullptr) {
+        if (!front())
+            return false;
+        return out_->ring.try_pop(v);
+    }
+
+    // return number of element cleared. in consumer thread
+    int clear() {
+        int n = 0;
+        while (pop())
+            n++;
+        return n;
+    }
+private:
+    struct segment {
+        explicit segment(size_t capacity) : ring(capacity) {}
+        spsc_ring<T> ring;
+        std::atomic<segment*> next = nullptr;
+    };
+
+    segment* out_; // consumer only
+    alignas(64) segment* in_; // producer only
+};
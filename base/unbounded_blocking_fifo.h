@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * MIT License
+ * Lock Free Unbounded Blocking MPSC FIFO
+ * https://github.com/wang-bin/lockless
+ */
+#pragma once
+#include "mpsc_fifo.h"
+#include "parker.h"
+#include <atomic>
+#include <chrono>
+#include <utility>
+
+// mpsc_fifo with recycled nodes, and consumer can block when empty.
+// Consumer parks only if empty, producers wake it only if it's parked, so no syscall when busy.
+template<typename T>
+class unbounded_blocking_fifo {
+public:
+    // return number of element cleared
+    int clear() {
+        return fifo_.clear();
+    } // in consumer thread
+
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        fifo_.emplace(std::forward<Args>(args)...);
+        wake();
+    }
+
+    void push(T&& v) {
+        fifo_.push(std::move(v));
+        wake();
+    }
+
+    bool try_pop(T* v = nullptr) {
+        return fifo_.pop(v);
+    }
+
+    // block until an element is available
+    void pop(T* v = nullptr) {
+        while (!try_pop(v)) {
+            if (prepare_wait(v))
+                return;
+            parker_.park();
+        }
+    }
+
+    // return false if no element after timeout
+    template<class Rep, class Period>
+    bool pop_for(T* v, const std::chrono::duration<Rep, Period>& timeout) {
+        if (try_pop(v))
+            return true;
+        if (prepare_wait(v))
+            return true;
+        parker_.park_for(timeout);
+        waiting_.store(false, std::memory_order_relaxed); // a late unpark() results in a spurious wakeup next time, which is fine
+        return try_pop(v);
+    }
+private:
+    void wake() {
+        // pairs with the fence in prepare_wait(): either consumer sees the new node, or we see waiting_
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting_.load(std::memory_order_relaxed) && waiting_.exchange(false, std::memory_order_acquire))
+            parker_.unpark();
+    }
+
+    // return true if popped
+    bool prepare_wait(T* v) {
+        waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!try_pop(v))
+            return false;
+        waiting_.store(false, std::memory_order_relaxed);
+        return true;
+    }
+
+    mpsc_fifo<T, true> fifo_;
+    std::atomic<bool> waiting_ = false;
+    parker parker_;
+};
@@ -5,6 +5,9 @@
 #include "ugs/PlatformSurface.h"
 #include <EGL/egl.h>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #define EGL_ENSURE(x, ...) EGL_RUN_CHECK(x, return __VA_ARGS__)
 #define EGL_WARN(x, ...) EGL_RUN_CHECK(x)
@@ -18,13 +21,18 @@
         } \
     } while(false)
 
-class ContextEGL
+// display, config and context. shared by surfaces of a context group
+class SharedEGL
 {
 public:
-  ContextEGL(EGLNativeWindowType window, void* extra_res) {
+  SharedEGL(void* extra_res) {
     EGL_ENSURE(display_ = eglGetDisplay((EGLNativeDisplayType)intptr_t(extra_res)));
-    int ver[2]{};
-    EGL_ENSURE(eglInitialize(display_, &ver[0], &ver[1]));
+    {
+      const std::lock_guard lock(displays_mtx_);
+      ++display_refs_[display_]; // released in dtor even if initialization fails
+      int ver[2]{};
+      EGL_ENSURE(eglInitialize(display_, &ver[0], &ver[1]));
+    }
 
     EGLint attr[] = {
       EGL_BUFFER_SIZE, 32,
@@ -38,12 +46,11 @@ public:
     EGL_WARN(ret = eglChooseConfig(display_, attr, &config_, 1, &nb_cfgs));
     if (ret == EGL_FALSE || nb_cfgs < 1) { // no error and return success even if pbuffer config is not found
       std::clog << "no config if surface type is set. try EGL_DONT_CARE" << std::endl;
-      attr[size(attr) - 2] = EGL_DONT_CARE;
+      attr[std::size(attr) - 2] = EGL_DONT_CARE;
       EGL_ENSURE(ret = eglChooseConfig(display_, attr, &config_, 1, &nb_cfgs));
     }
     if (nb_cfgs < 1) // fallback to renderable type es2 if current is es3?
       return;
-    EGL_ENSURE(surface_ = eglCreateWindowSurface(display_, config_, window, nullptr));
 
     EGLint attribs[] = {
       EGL_CONTEXT_CLIENT_VERSION, 2,
@@ -52,40 +59,96 @@ public:
     EGL_ENSURE(ctx_ = eglCreateContext(display_, config_, EGL_NO_CONTEXT, &attribs[0]));
   }
 
-  ~ContextEGL() {
+  ~SharedEGL() {
     if (display_ == EGL_NO_DISPLAY)
       return;
     EGL_WARN(eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT));
     if (ctx_ != EGL_NO_CONTEXT)
       EGL_WARN(eglDestroyContext(display_, ctx_));
-    if (surface_ != EGL_NO_SURFACE)
-      EGL_WARN(eglDestroySurface(display_, surface_));
     EGL_WARN(eglReleaseThread());
-    EGL_WARN(eglTerminate(display_)); //
+    {
+      // the same native display is the same EGLDisplay, and eglTerminate() invalidates all contexts and surfaces of it, including the ones of other SharedEGL
+      const std::lock_guard lock(displays_mtx_);
+      if (--display_refs_[display_] == 0) {
+        display_refs_.erase(display_);
+        EGL_WARN(eglTerminate(display_));
+      }
+    }
     display_ = EGL_NO_DISPLAY;
   }
 
+  EGLDisplay display_ = EGL_NO_DISPLAY;
+  EGLContext ctx_ = EGL_NO_CONTEXT;
+  EGLConfig config_ = nullptr;
+private:
+  static inline std::mutex displays_mtx_;
+  static inline std::unordered_map<EGLDisplay, int> display_refs_; // SharedEGL alive of each display
+};
+
+// window surface of a context. the context is owned or shared with other surfaces
+class ContextEGL
+{
+public:
+  ContextEGL(EGLNativeWindowType window, void* extra_res)
+    : own_(new SharedEGL(extra_res))
+    , shared_(own_.get()) {
+    createSurface(window);
+  }
+
+  ContextEGL(EGLNativeWindowType window, SharedEGL* shared)
+    : shared_(shared) {
+    createSurface(window);
+  }
+
+  ~ContextEGL() {
+    destroySurface();
+  }
+
+  // keep the context, replace the window surface. window can be null
+  bool resetSurface(EGLNativeWindowType window) {
+    destroySurface();
+    if (!window)
+      return true;
+    createSurface(window);
+    return surface_ != EGL_NO_SURFACE;
+  }
+
   void swapBuffers() {
-    EGL_ENSURE(eglSwapBuffers(display_, surface_));
+    EGL_ENSURE(eglSwapBuffers(shared_->display_, surface_));
   }
 
   bool makeCurrent() {
-    //thread_local ContextEGL* currentCtx = nullptr;
-    //if (this == currentCtx)
-    //  return true;
     EGLBoolean ok = EGL_FALSE;
-    EGL_ENSURE(ok = eglMakeCurrent(display_, surface_, surface_, ctx_), false);
+    EGL_ENSURE(ok = eglMakeCurrent(shared_->display_, surface_, surface_, shared_->ctx_), false);
     if (ok != EGL_TRUE)
       return false;
-    //currentCtx = this;
     return true;
   }
 
+  bool doneCurrent() {
+    EGLBoolean ok = EGL_FALSE;
+    EGL_ENSURE(ok = eglMakeCurrent(shared_->display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT), false);
+    return ok == EGL_TRUE;
+  }
+
 private:
-  EGLDisplay display_ = EGL_NO_DISPLAY;
-  EGLContext ctx_ = EGL_NO_CONTEXT;
+  void createSurface(EGLNativeWindowType window) {
+    if (shared_->ctx_ == EGL_NO_CONTEXT)
+      return;
+    EGL_ENSURE(surface_ = eglCreateWindowSurface(shared_->display_, shared_->config_, window, nullptr));
+  }
+
+  void destroySurface() {
+    if (shared_->display_ == EGL_NO_DISPLAY || surface_ == EGL_NO_SURFACE)
+      return;
+    EGL_WARN(eglMakeCurrent(shared_->display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT));
+    EGL_WARN(eglDestroySurface(shared_->display_, surface_));
+    surface_ = EGL_NO_SURFACE;
+  }
+
+  std::unique_ptr<SharedEGL> own_;
+  SharedEGL* shared_ = nullptr;
   EGLSurface surface_ = EGL_NO_SURFACE;
-  EGLConfig config_ = nullptr;
 };
 
 void* EGLRenderLoop::createRenderContext(PlatformSurface* surface)
@@ -111,10 +174,51 @@ bool EGLRenderLoop::activateRenderContext(PlatformSurface* surface, void* ctx)
   return static_cast<ContextEGL*>(ctx)->makeCurrent();
 }
 
-bool EGLRenderLoop::submitRenderContext(PlatformSurface* surface, void* ctx)
+bool EGLRenderLoop::submitRenderContext(PlatformSurface* surface, void* ctx, int* changes)
 {
   if (!ctx)
     return false;
   static_cast<ContextEGL*>(ctx)->swapBuffers();
   return true;
 }
+
+bool EGLRenderLoop::releaseRenderContext(PlatformSurface* surface, void* ctx)
+{
+  if (!ctx)
+    return false;
+  return static_cast<ContextEGL*>(ctx)->doneCurrent();
+}
+
+bool EGLRenderLoop::resetRenderContextSurface(PlatformSurface* surface, void* ctx)
+{
+  if (!ctx)
+    return false;
+  std::clog << "resetRenderContextSurface: " << ctx << " to native window " << surface->nativeHandleForGL() << std::endl;
+  return static_cast<ContextEGL*>(ctx)->resetSurface(reinterpret_cast<EGLNativeWindowType>(surface->nativeHandleForGL()));
+}
+
+bool EGLRenderLoop::detachRenderContext(PlatformSurface* surface, void* ctx)
+{
+  if (!ctx)
+    return false;
+  return static_cast<ContextEGL*>(ctx)->resetSurface(EGLNativeWindowType{});
+}
+
+void* EGLRenderLoop::createSharedRenderContext(PlatformSurface* surface)
+{
+  std::clog << "createSharedRenderContext with extra native res " << surface->nativeResource() << std::endl;
+  return new SharedEGL(surface->nativeResource());
+}
+
+bool EGLRenderLoop::destroySharedRenderContext(void* shared)
+{
+  delete static_cast<SharedEGL*>(shared);
+  return true;
+}
+
+void* EGLRenderLoop::createRenderContextShared(PlatformSurface* surface, void* shared)
+{
+  if (!surface->nativeHandleForGL())
+    return nullptr;
+  return new ContextEGL(reinterpret_cast<EGLNativeWindowType>(surface->nativeHandleForGL()), static_cast<SharedEGL*>(shared));
+}
@@ -11,5 +11,11 @@ protected:
   void* createRenderContext(PlatformSurface* surface) override;
   bool destroyRenderContext(PlatformSurface* surface, void* ctx) override;
   bool activateRenderContext(PlatformSurface* surface, void* ctx) override;
-  bool submitRenderContext(PlatformSurface* surface, void* ctx) override;
+  bool submitRenderContext(PlatformSurface* surface, void* ctx, int* changes) override;
+  bool releaseRenderContext(PlatformSurface* surface, void* ctx) override;
+  bool resetRenderContextSurface(PlatformSurface* surface, void* ctx) override;
+  bool detachRenderContext(PlatformSurface* surface, void* ctx) override;
+  void* createSharedRenderContext(PlatformSurface* surface) override;
+  bool destroySharedRenderContext(void* shared) override;
+  void* createRenderContextShared(PlatformSurface* surface, void* shared) override;
 };
\ No newline at end of file
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * schedule-to-execute latency of render loop task queues
+ */
+#include "base/BlockingQueue.h"
+#include "base/unbounded_blocking_fifo.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+using Task = function<void()>;
+
+struct Stats {
+    void print(const char* name) {
+        sort(v.begin(), v.end());
+        double sum = 0;
+        for (auto x : v)
+            sum += x;
+        printf("%-28s n=%zu mean=%.2fus p50=%.2fus p99=%.2fus max=%.2fus\n", name, v.size(), sum / v.size() / 1000.0
+            , v[v.size() / 2] / 1000.0, v[v.size() * 99 / 100] / 1000.0, v.back() / 1000.0);
+    }
+    vector<int64_t> v;
+};
+
+// producer schedules a task every `interval`(consumer is parked between tasks, e.g. input events), or back to back if 0
+template<class Push, class Pop>
+void run(const char* name, Push&& push, Pop&& pop, int count, microseconds interval)
+{
+    Stats st;
+    st.v.reserve(count);
+    thread consumer([&]{
+        for (int i = 0; i < count; ++i) {
+            Task t;
+            pop(t);
+            t();
+        }
+    });
+    for (int i = 0; i < count; ++i) {
+        const auto t0 = steady_clock::now();
+        push([t0, &st]{ st.v.push_back(duration_cast<nanoseconds>(steady_clock::now() - t0).count()); });
+        if (interval.count() > 0)
+            this_thread::sleep_for(interval);
+    }
+    consumer.join();
+    st.print(name);
+}
+
+int main(int argc, char* argv[])
+{
+    const int count = argc > 1 ? atoi(argv[1]) : 20000;
+    for (auto interval : {microseconds(0), microseconds(100)}) {
+        printf("task interval %lldus\n", (long long)interval.count());
+        BlockingQueue<Task> bq;
+        run("BlockingQueue", [&](Task&& t) { bq.push(std::move(t));}, [&](Task& t) { bq.pop(t);}, count, interval);
+        unbounded_blocking_fifo<Task> fifo;
+        run("unbounded_blocking_fifo", [&](Task&& t) { fifo.push(std::move(t));}, [&](Task& t) { fifo.pop(&t);}, count, interval);
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * throughput and allocations of mpsc_fifo with and without node recycling, and spsc_fifo for a single producer
+ */
+#include "base/mpsc_fifo.h"
+#include "base/spsc_ring.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+static atomic<uint64_t> allocs = 0;
+
+void* operator new(size_t size)
+{
+    allocs.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p);}
+void operator delete(void* p, size_t) noexcept { free(p);}
+
+// the same size as PlatformSurface::Event
+struct Event {
+    int type = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// producers push count events in total, consumer pops all of them
+template<bool Recycle>
+void run(const char* name, int producers, int count)
+{
+    mpsc_fifo<Event, Recycle> fifo;
+    const auto a0 = allocs.load();
+    const auto t0 = steady_clock::now();
+    vector<thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&fifo, p, n = count / producers]{
+            for (int i = 0; i < n; ++i)
+                fifo.push(Event{p, i, i});
+        });
+    }
+    int popped = 0;
+    const int total = count / producers * producers;
+    while (popped < total) {
+        if (fifo.pop())
+            ++popped;
+        else
+            this_thread::yield();
+    }
+    for (auto& t : threads)
+        t.join();
+    const auto dt = duration<double>(steady_clock::now() - t0).count();
+    printf("%-22s producers=%d %.2f M/s allocs=%llu\n", name, producers, total / dt / 1e6, (unsigned long long)(allocs.load() - a0));
+}
+
+void run_spsc(int count)
+{
+    spsc_fifo<Event> fifo;
+    const auto a0 = allocs.load();
+    const auto t0 = steady_clock::now();
+    thread producer([&fifo, count]{
+        for (int i = 0; i < count; ++i)
+            fifo.push(Event{0, i, i});
+    });
+    for (int popped = 0; popped < count;) {
+        if (fifo.pop())
+            ++popped;
+        else
+            this_thread::yield();
+    }
+    producer.join();
+    const auto dt = duration<double>(steady_clock::now() - t0).count();
+    printf("%-22s producers=1 %.2f M/s allocs=%llu\n", "spsc_fifo", count / dt / 1e6, (unsigned long long)(allocs.load() - a0));
+}
+
+int main(int argc, char* argv[])
+{
+    const int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    run_spsc(count);
+    for (int producers : {1, 2, 4}) {
+        run<false>("mpsc_fifo new/delete", producers, count);
+        run<true>("mpsc_fifo recycled", producers, count);
+    }
+    return 0;
+}
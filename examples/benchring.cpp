@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * throughput of bounded mpmc_ring vs mpsc_fifo and BlockingQueue(deque/ring_buffer, pop/popBatch), n producers and 1 consumer
+ */
+#include "base/BlockingQueue.h"
+#include "base/mpmc_ring.h"
+#include "base/mpsc_fifo.h"
+#include "base/ring_buffer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+// the same size as PlatformSurface::Event
+struct Event {
+    int type = 0;
+    int width = 0;
+    int height = 0;
+};
+
+static constexpr size_t kCapacity = 1024;
+static constexpr size_t kBatch = 32;
+
+// produce(p, n) pushes n events in producer p, consume(total) pops total events
+template<typename Produce, typename Consume>
+void run(const char* name, int producers, int count, Produce&& produce, Consume&& consume)
+{
+    const int n = count / producers;
+    const int total = n * producers;
+    const auto t0 = steady_clock::now();
+    vector<thread> threads;
+    for (int p = 0; p < producers; ++p)
+        threads.emplace_back([&produce, p, n]{ produce(p, n); });
+    consume(total);
+    for (auto& t : threads)
+        t.join();
+    const auto dt = duration<double>(steady_clock::now() - t0).count();
+    printf("%-22s producers=%d %.2f M/s\n", name, producers, total / dt / 1e6);
+}
+
+int main(int argc, char* argv[])
+{
+    const int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    for (int producers : {1, 2, 4, 8}) {
+        {
+            mpmc_ring<Event> q(kCapacity);
+            run("mpmc_ring spin", producers, count, [&](int p, int n) {
+                for (int i = 0; i < n; ++i) {
+                    while (!q.try_push(Event{p, i, i}))
+                        this_thread::yield();
+                }
+            }, [&](int total) {
+                for (int popped = 0; popped < total;) {
+                    if (q.try_pop())
+                        ++popped;
+                    else
+                        this_thread::yield();
+                }
+            });
+        }
+        {
+            blocking_ring<Event> q(kCapacity);
+            run("blocking_ring", producers, count, [&](int p, int n) {
+                for (int i = 0; i < n; ++i)
+                    q.push(Event{p, i, i});
+            }, [&](int total) {
+                for (int popped = 0; popped < total; ++popped)
+                    q.pop();
+            });
+        }
+        {
+            blocking_ring<Event> q(kCapacity);
+            run("blocking_ring batch", producers, count, [&](int p, int n) {
+                Event e[kBatch];
+                for (int i = 0; i < n;) {
+                    const int k = min<int>(kBatch, n - i);
+                    for (int j = 0; j < k; ++j)
+                        e[j] = Event{p, i + j, i + j};
+                    q.push_batch(e, k);
+                    i += k;
+                }
+            }, [&](int total) {
+                Event e[kBatch];
+                for (int popped = 0; popped < total;)
+                    popped += q.pop_batch(e, kBatch);
+            });
+        }
+        {
+            mpsc_fifo<Event, true> q;
+            run("mpsc_fifo recycled", producers, count, [&](int p, int n) {
+                for (int i = 0; i < n; ++i)
+                    q.push(Event{p, i, i});
+            }, [&](int total) {
+                for (int popped = 0; popped < total;) {
+                    if (q.pop())
+                        ++popped;
+                    else
+                        this_thread::yield();
+                }
+            });
+        }
+        {
+            BlockingQueue<Event, deque> q(kCapacity);
+            run("BlockingQueue", producers, count, [&](int p, int n) {
+                for (int i = 0; i < n; ++i)
+                    q.push(Event{p, i, i});
+            }, [&](int total) {
+                Event e;
+                for (int popped = 0; popped < total; ++popped)
+                    q.pop(e);
+            });
+        }
+        {
+            BlockingQueue<Event, ring_buffer> q(kCapacity);
+            run("BlockingQueue ring", producers, count, [&](int p, int n) {
+                for (int i = 0; i < n; ++i)
+                    q.push(Event{p, i, i});
+            }, [&](int total) {
+                Event e;
+                for (int popped = 0; popped < total; ++popped)
+                    q.pop(e);
+            });
+        }
+        {
+            BlockingQueue<Event, ring_buffer> q(kCapacity);
+            run("BlockingQueue popBatch", producers, count, [&](int p, int n) {
+                for (int i = 0; i < n; ++i)
+                    q.push(Event{p, i, i});
+            }, [&](int total) {
+                Event e[kBatch];
+                for (int popped = 0; popped < total;)
+                    popped += q.popBatch(e, kBatch);
+            });
+        }
+    }
+    return 0;
+}
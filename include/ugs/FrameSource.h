@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2025 WangBin <wbsecg1 at gmail.com>
+ * This file is part of UGS (Universal Graphics Surface)
+ * Source code: https://github.com/wang-bin/ugs
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+#include "export.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+UGS_NS_BEGIN
+class RenderLoop;
+/*!
+ * \brief The FrameSource class
+ * Frame advance service which decides when RenderLoop draws a new frame, e.g. a clock, vsync, user or external master clock(audio).
+ * Any number of sources can be added to a RenderLoop, requests from all sources are merged, at most 1 draw pass is pending.
+ */
+class UGS_API FrameSource
+{
+public:
+    virtual ~FrameSource();
+    // request a new frame. can be called in any thread. no effect if not added to a RenderLoop
+    void requestFrame();
+protected:
+    FrameSource();
+    // the following functions are called by RenderLoop
+    virtual void start() {} // render loop is running
+    virtual void stop() {}
+    virtual void presented() {} // called in rendering thread after frames are presented
+    virtual void idle() {} // called in rendering thread if a draw pass presents nothing, e.g. no dirty surface, no context, or onDraw() returns false
+private:
+    friend class RenderLoop;
+    void setTrigger(const std::function<void()>& cb);
+    class Private;
+    Private* d;
+};
+
+// request frames manually, the same as RenderLoop.update()
+class UGS_API ManualFrameSource final : public FrameSource
+{
+};
+
+/*!
+ * \brief The VSyncFrameSource class
+ * Request a new frame when the previous one is presented. swap buffers blocks until vblank, so frames are paced by vsync.
+ * If a pass presents nothing, the next frame is requested by a fallback timer, so the chain is not broken.
+ */
+class UGS_API VSyncFrameSource final : public FrameSource
+{
+public:
+    VSyncFrameSource();
+    ~VSyncFrameSource() override;
+protected:
+    void start() override;
+    void stop() override;
+    void presented() override;
+    void idle() override;
+private:
+    class Fallback;
+    Fallback* fallback_;
+};
+
+// request frames at absolute deadlines of steady clock. rounding errors are not accumulated, and missed deadlines are skipped
+class UGS_API TimerFrameSource final : public FrameSource
+{
+public:
+    TimerFrameSource(float fps);
+    ~TimerFrameSource() override;
+    void setFrameRate(float fps);
+    float frameRate() const;
+    uint64_t droppedTicks() const; // deadlines skipped because the clock thread is late
+protected:
+    void start() override;
+    void stop() override;
+private:
+    class Clock;
+    Clock* clock_;
+};
+
+/*!
+ * \brief The ExternalClockFrameSource class
+ * Frames are paced by a master clock driven by user, e.g. audio clock updated in audio callback.
+ * A frame is requested when the clock reaches the next frame time. If fps is 0, every clock update requests a frame.
+ */
+class UGS_API ExternalClockFrameSource final : public FrameSource
+{
+public:
+    ExternalClockFrameSource(float fps = 0);
+    void setFrameRate(float fps);
+    // seconds. can be called in any thread but should be called by 1 thread
+    void setClock(double value);
+private:
+    std::atomic<float> fps_ = 0;
+    std::atomic<double> next_ = 0; // reset by setFrameRate() in another thread
+};
+UGS_NS_END
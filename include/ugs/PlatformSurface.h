@@ -12,6 +12,7 @@
 #include <limits>
 #include "export.h"
 #include <functional>
+#include <thread>
 
 UGS_NS_BEGIN
 /*!
@@ -65,6 +66,13 @@ public:
     virtual ~PlatformSurface();
     Type type() const;
     void setEventCallback(const std::function<void()>& cb); // TODO: void(Event) as callback and remove event queue which can be implemented externally
+    /*!
+     * \brief setEventThread
+     * Events generated in thread id, usually the only thread calling processEvents(), are queued in a wait free SPSC fifo, events from other threads are queued in a MPSC fifo.
+     * Events are popped in push order of both fifos. A default constructed id(the initial value) disables the SPSC fifo.
+     * MUST NOT be changed while the old event thread is generating events. RenderLoop sets it to the thread calling dispatch() in embedded mode.
+     */
+    void setEventThread(std::thread::id id = std::this_thread::get_id());
     //
     void resetNativeHandle(void* h);
     void* nativeHandle() const;
@@ -81,6 +89,10 @@ public:
     virtual void resize(int w, int h);
     virtual void close();
     virtual void processEvents() {}
+    // a pollable fd readable when native events arrive, e.g. x11/wayland display connection, drm fd. -1 if not supported. processEvents() MUST drain the events
+    virtual int eventFd() const { return -1;}
+    // native events already read from eventFd() into a user space queue, e.g. by another thread, so the fd is not readable for them
+    virtual bool eventsQueued() const { return false;}
     virtual bool acquire() { return true;}
     virtual void release() {}
     /*!
@@ -8,13 +8,23 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 #pragma once
-#include "export.h"
+#include "FrameSource.h"
+#include <cstdint>
 #include <functional>
 #include <memory>
 
 UGS_NS_BEGIN
 class PlatformSurface;
 using RenderContext = void*;
+
+// a frame of a surface built by onPrepare() and drawn by onDraw()
+struct FrameInfo {
+    uint64_t number = 0; // frame number of the surface starting from 1. 0: not prepared
+    int width = 0; // surface size when the frame is requested
+    int height = 0;
+    std::shared_ptr<void> data; // produced by onPrepare(), consumed by onDraw()
+};
+
 class UGS_API RenderLoop
 {
 public:
@@ -26,39 +36,156 @@ public:
     /// MUST call stop() && waitForStopped() manually before destroying RenderLoop
     void waitForStopped();  // not required for foreign surface handles, run event loop and observe resize using gui kit api
     bool isRunning() const;
-    void update(); // schedule onDraw for all surfaces
+    /*!
+     * \brief setEmbedded
+     * Embedded mode: no rendering thread is created, rendering tasks and native events are processed in the thread calling dispatch() or runPending(),
+     * so render loop can be integrated into an existing event loop(epoll, libuv, glib etc.). MUST be called before start()
+     */
+    void setEmbedded(bool value = true);
+    /*!
+     * \brief setRenderThreads
+     * Number of rendering threads, default is 1. A surface is pinned to the least loaded thread when added, so its context is always current in that thread.
+     * Callbacks of a surface are called in 1 thread in order, while callbacks of different surfaces can be called concurrently if n > 1.
+     * When a surface is closed, another surface can be moved from the most loaded thread if releaseRenderContext() is implemented.
+     * MUST be called before start() and add(). Embedded mode has only 1 rendering thread.
+     */
+    void setRenderThreads(int n);
+    /*!
+     * \brief setTwoPhasePresent
+     * A draw pass of a rendering thread issues onDraw() for all surfaces first, then submits and presents them. So a swap blocked by vsync or flow control
+     * does not delay drawing the other surfaces, and N windows can present in the same vblank instead of N vblanks.
+     * A swap is issued in the thread where its context is current, so draws and presents of 1 rendering thread still run one after another in that thread, nothing is overlapped.
+     * Presents only overlap with draws and presents of other rendering threads, so it helps throughput only if setRenderThreads() > 1.
+     * Only affects update() and frame source passes, draws for events and prepared frames(onPrepare()) are presented immediately. MUST be called before start()
+     */
+    void setTwoPhasePresent(bool value = true);
+    /*!
+     * \brief setSharedContext
+     * All surfaces added by add(surface) share 1 render context, i.e. add(surface, 0). Textures, programs and buffers are shared instead of duplicated per surface.
+     * The backend MUST implement createSharedRenderContext() and createRenderContextShared(), otherwise every surface creates its own context.
+     */
+    void setSharedContext(bool value = true);
+    /*!
+     * \brief setAsyncContextCreation
+     * createRenderContext() is called in prepare threads instead of the rendering thread, so contexts of surfaces opened at the same time are created in parallel,
+     * and a rendering thread keeps drawing other surfaces meanwhile. createRenderContext() MUST be thread safe and MUST NOT leave the context current.
+     * Surfaces sharing a context(see add(surface, contextGroup)) are not affected. MUST be called before start()
+     */
+    void setAsyncContextCreation(bool value = true);
+    /*!
+     * \brief setContextPool
+     * Contexts of closed surfaces are detached by detachRenderContext() and kept in a LRU pool of at most size contexts. A new surface with the same nativeResource()
+     * reuses the most recently pooled one by resetRenderContextSurface() instead of createRenderContext(). onDestroyContext() and onContextCreated() are still called.
+     * A pooled context is destroyed if not reused in idleTimeout ms(<= 0: never), checked when rendering and when idle. Contexts shared by surfaces are not pooled. size <= 0: disabled(default)
+     * destroyRenderContext(nullptr, ctx) for a pooled context is called in a rendering thread, which may be not the one detached it if there are multiple rendering threads.
+     */
+    void setContextPool(int size, int idleTimeout = 10000);
+    uint64_t contextPoolHits() const; // contexts reused from the pool
+    uint64_t contextPoolMisses() const; // contexts created because the pool has no compatible context
+    // embedded mode only. a pollable fd which is readable if tasks or native events are pending, then call dispatch(0). -1 if not supported, call dispatch() periodically
+    int fd() const;
+    // embedded mode only. wait for tasks or native events at most timeout ms(-1: infinite), process native events, then run pending tasks. return number of tasks run
+    int dispatch(int timeout = 0);
+    // embedded mode only. run pending tasks without waiting and native event processing. return number of tasks run
+    int runPending();
+    void update(); // schedule onDraw for all surfaces. calls before the next draw are merged into 1 draw per surface
+    void update(const std::weak_ptr<PlatformSurface>& surface); // schedule onDraw for the surface only. merged with pending update()
     /*!
      * \brief setFrameRate
      * \param fps
      * -1: vsync
      * 0: manually update()
-     * +: auto update at fps
+     * +: auto update at fps. ticks are scheduled at absolute deadlines, see TimerFrameSource
+     * It's a shortcut to replace the VSyncFrameSource or TimerFrameSource added by previous setFrameRate()
      */
     void setFrameRate(float fps = 0);
+    /*!
+     * \brief setFrameRate
+     * Frame rate of a surface, independent of the global one. fps > 0: the surface is redrawn at its own absolute deadlines, and is not drawn by update() and frame source passes.
+     * Deadlines of all surfaces are on the same time base, surfaces due at the same time are drawn in 1 pass, e.g. every 4th frame of a 60fps surface with a 15fps one.
+     * limitOnly: a deadline redraws the surface only if update() or a frame source requested since the previous deadline, i.e. a rate limit instead of a rate target.
+     * fps <= 0: follow update() and frame sources(default). Events(e.g. resize) are always drawn immediately
+     */
+    void setFrameRate(const std::weak_ptr<PlatformSurface>& surface, float fps, bool limitOnly = false);
+    uint64_t coalescedUpdates() const; // update() and frame source requests merged into an already pending draw pass
+    /*!
+     * \brief setFrameBudget
+     * Deadline aware draw passes. Surfaces to be drawn in a pass are ordered by deadline, which is the pass start plus frame period of the surface(setFrameRate(surface, fps)),
+     * or plus ms if the surface has no frame rate. Surfaces with the same deadline are ordered by priority(setPriority()).
+     * A frame is skipped if the estimated draw time of the surface plus the time reserved for remaining surfaces of higher priority exceeds ms, so lower priority
+     * surfaces degrade first under load. Surfaces of the highest priority in a pass are never skipped. Draw times are estimated from previous frames.
+     * ms <= 0: disabled, surfaces are drawn in order and deadlines are not checked(default). Not applied if onPrepare() is set
+     */
+    void setFrameBudget(float ms);
+    void setPriority(const std::weak_ptr<PlatformSurface>& surface, int priority); // larger is more important. default 0
+    uint64_t skippedFrames() const; // frames skipped by frame budget
+    uint64_t missedDeadlines() const; // frames submitted after the deadline, see setFrameBudget()
+    // requests of all frame sources are merged, at most 1 draw pass is pending. sources are started/stopped with render loop
+    void addFrameSource(const std::shared_ptr<FrameSource>& source);
+    void removeFrameSource(const std::shared_ptr<FrameSource>& source);
 
     // takes the ownership. but surface ptr can be accessed before close. To remove surface, call surface->close()
     std::weak_ptr<PlatformSurface> add(PlatformSurface* surface);
+    /*!
+     * \brief add
+     * Surfaces of the same contextGroup(>= 0) share 1 render context created by createSharedRenderContext() from the first surface, and the backend only
+     * creates a per surface drawable(e.g. EGLSurface, swapchain) by createRenderContextShared(). The shared context is ref counted and destroyed with the last
+     * surface of the group. Surfaces of a group are pinned to the same rendering thread and never moved. contextGroup < 0: not shared
+     */
+    std::weak_ptr<PlatformSurface> add(PlatformSurface* surface, int contextGroup);
+    /*!
+     * \brief onPrepare
+     * Optional CPU stage before onDraw(), e.g. culling, vertex generation and text layout. Called in prepare threads without gfx context,
+     * frames of all surfaces to be drawn are prepared in parallel, then passed to onDraw() in rendering thread. So frame N+1 is prepared while frame N is drawn and presented.
+     * At most 1 frame of a surface is being prepared, requests in the meantime are merged, and only the latest prepared frame is drawn.
+     * MUST be called before start()
+     */
+    RenderLoop& onPrepare(const std::function<void(PlatformSurface*, FrameInfo&)>& cb);
     /// the following functions are called in rendering thread
     RenderLoop& onResize(const std::function<void(PlatformSurface*, int w, int h, RenderContext)>& cb);
     // draw callback requres RenderContext parameter for d3d11, vulkan. opengl does not need it because context is implicit
     RenderLoop& onDraw(const std::function<bool(PlatformSurface*, RenderContext)>& cb);
+    // frame is the latest one from onPrepare(), or an empty frame if onPrepare() is not set
+    RenderLoop& onDraw(const std::function<bool(PlatformSurface*, RenderContext, const FrameInfo& frame)>& cb);
     // callback after context is created
     RenderLoop& onContextCreated(const std::function<void(PlatformSurface*, RenderContext)>& cb);
     // callback before destroying context. For example, happens when resetNativeHandle(nullptr)=>close()
     RenderLoop& onDestroyContext(const std::function<void(PlatformSurface*, RenderContext)>& cb); // called when gfx context on the surface is about to be destroyed. User can destroy gfx resources in the callback
+    // callback after the native handle is changed and the context is retained by resetRenderContextSurface(), context is current with the new handle. Not called if the new handle is null
+    RenderLoop& onSurfaceChanged(const std::function<void(PlatformSurface*, RenderContext)>& cb);
+    // callback after a frame is submitted later than its deadline by lateUs microseconds, see setFrameBudget()
+    RenderLoop& onDeadlineMissed(const std::function<void(PlatformSurface*, int64_t lateUs)>& cb);
     // callback before surface close after context is destroyed
     RenderLoop& onClose(const std::function<void(PlatformSurface*)>& cb); // called when surface is about to be destroyed
 protected:
     virtual void* createRenderContext(PlatformSurface* surface) = 0;
+    // surface is null if ctx is from the context pool
     virtual bool destroyRenderContext(PlatformSurface* surface, void* ctx) = 0;
+    // not called if surface and ctx are already current in the rendering thread. callbacks making another context current must restore it
     virtual bool activateRenderContext(PlatformSurface* surface, void* ctx) = 0;
     // changes: 1 if new format wanted, will invoke resize callback
     virtual bool submitRenderContext(PlatformSurface* surface, void* ctx, int* changes = nullptr) = 0;
+    // make ctx not current in the calling thread, then it will be activated in another rendering thread. return false if not supported, and the surface will not be moved
+    virtual bool releaseRenderContext(PlatformSurface* /*surface*/, void* /*ctx*/) { return false;}
+    /*!
+     * \brief resetRenderContextSurface
+     * Called when the native handle of surface is changed, e.g. android surface recreation, reparenting. Replace the drawable bound to ctx(e.g. EGLSurface, swapchain) with
+     * the one of surface->nativeHandle(), or release the drawable if the handle is null, while the context and its resources are kept.
+     * Return false if not supported, then ctx is destroyed and a new one is created.
+     */
+    virtual bool resetRenderContextSurface(PlatformSurface* /*surface*/, void* /*ctx*/) { return false;}
+    // release the drawable of a closed surface and make ctx not current, then ctx is kept in the context pool(see setContextPool()). return false if not supported, and ctx is destroyed
+    virtual bool detachRenderContext(PlatformSurface* /*surface*/, void* /*ctx*/) { return false;}
+    // context shared by surfaces of a group, see add(surface, contextGroup). surface is the first one of the group. return null if not supported, then createRenderContext() is used
+    virtual void* createSharedRenderContext(PlatformSurface* /*surface*/) { return nullptr;}
+    // called after all contexts created from shared are destroyed
+    virtual bool destroySharedRenderContext(void* /*shared*/) { return false;}
+    // create a per surface context(drawable) using shared context. the result is activated, submitted and destroyed like the one from createRenderContext()
+    virtual void* createRenderContextShared(PlatformSurface* /*surface*/, void* /*shared*/) { return nullptr;}
 private:
     class SurfaceContext;
     // process surface events and do rendering. return input surface, or null if surface is no longer used, e.g. closed
     PlatformSurface* process(SurfaceContext* sp);
-    // TODO: frame advance service abstraction(clock, vsync, user)
     class Private;
     Private* d;
 };